@@ -22,4 +22,19 @@ typedef struct buf {
     ListNode node;
     Semaphore sl;
     Semaphore buf_complete;
+
+    // a transfer of `count` blocks from `blockno`. 0 or 1 is a single block.
+    u32 count;
+    // if not NULL, the blocks are transferred to or from `blocks` directly
+    // instead of `data`. it must be word-aligned.
+    u8* blocks;
+    // if not NULL, block i of the transfer is `vec[i]` instead, so adjacent
+    // blocks need not be adjacent in memory.
+    u8** vec;
+    // if not NULL, called by `sd_intr` when the transfer is done, instead of
+    // posting `sl`. see `sd_submit`.
+    void (*end_io)(struct buf*);
+    // for `end_io`. the host tests include this header as C++, so no
+    // C++ keywords such as `private` as names.
+    void* end_io_arg;
 } buf;
\ No newline at end of file
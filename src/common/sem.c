@@ -2,6 +2,7 @@
 #include <kernel/mem.h>
 #include <kernel/sched.h>
 #include <kernel/printk.h>
+#include <kernel/cpu.h>
 
 void init_sem(Semaphore* sem, int val)
 {
@@ -88,6 +89,71 @@ bool _wait_sem(Semaphore* sem, bool alertable)
     return ret;
 }
 
+typedef struct {
+    struct timer timer;
+    struct proc* proc;
+    volatile bool done;
+} SemTimeout;
+
+static void sem_timeout_handler(struct timer* t)
+{
+    auto st = container_of(t, SemTimeout, timer);
+    activate_proc(st->proc);
+    __atomic_store_n(&st->done, true, __ATOMIC_RELEASE);
+}
+
+int _wait_sem_timeout(Semaphore* sem, bool alertable, u64 timeout_ms)
+{
+    setup_checker(0);
+    checker_begin_ctx(0);
+    if (--sem->val >= 0)
+    {
+        release_spinlock(0, &sem->lock);
+        return 1;
+    }
+    WaitData* wait = kalloc(sizeof(WaitData));
+    wait->proc = thisproc();
+    wait->up = false;
+    _insert_into_list(&sem->sleeplist, &wait->slnode);
+    // the timer lives on our stack, which stays valid until it is either
+    // cancelled or its handler has finished.
+    SemTimeout st;
+    st.timer.elapse = (int)MIN(timeout_ms, (u64)0x7fffffff);
+    st.timer.handler = sem_timeout_handler;
+    st.proc = thisproc();
+    st.done = false;
+    set_cpu_timer(&st.timer);
+    lock_for_sched(0);
+    release_spinlock(0, &sem->lock);
+    sched(0, alertable ? SLEEPING : DEEPSLEEPING);
+    bool timeout = !try_cancel_cpu_timer(&st.timer);
+    if (timeout)
+        while (!__atomic_load_n(&st.done, __ATOMIC_ACQUIRE))
+            arch_yield();
+    acquire_spinlock(0, &sem->lock);
+    if (!wait->up)
+    {
+        ASSERT(++sem->val <= 0);
+        _detach_from_list(&wait->slnode);
+    }
+    release_spinlock(0, &sem->lock);
+    int ret = wait->up ? 1 : (timeout ? 0 : -1);
+    kfree(wait);
+    return ret;
+}
+
+int _wake_sem(Semaphore* sem, int n)
+{
+    int ret = 0;
+    // -val is the number of sleepers
+    while (ret < n && sem->val < 0)
+    {
+        _post_sem(sem);
+        ret++;
+    }
+    return ret;
+}
+
 void _post_sem(Semaphore* sem)
 {
     if (++sem->val <= 0)
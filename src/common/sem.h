@@ -23,7 +23,17 @@ WARN_RESULT int _query_sem(Semaphore*);
 void _lock_sem(Semaphore*);
 void _unlock_sem(Semaphore*);
 WARN_RESULT bool _wait_sem(Semaphore*, bool alertable);
+// like _wait_sem, but gives up after timeout_ms milliseconds.
+// return 1 if the sem is acquired, 0 on timeout, -1 if woken up by other sources.
+WARN_RESULT int _wait_sem_timeout(Semaphore*, bool alertable, u64 timeout_ms);
 void _post_sem(Semaphore*);
+// Every waiter of a Semaphore is exclusive: a post wakes up exactly one.
+// _wake_sem wakes up at most n sleepers, but unlike posting, it never
+// leaves a count behind for later waiters. It's for wait queues whose
+// condition is checked under another lock before sleeping.
+// Return the number of woken sleepers.
+int _wake_sem(Semaphore*, int n);
+#define wake_sem(sem, n) ({_lock_sem(sem); int __ret = _wake_sem(sem, n); _unlock_sem(sem); __ret;})
 #define lock_sem(checker, sem) checker_begin_ctx_before_call(checker, _lock_sem, sem)
 #define unlock_sem(checker, sem) checker_end_ctx_after_call(checker, _unlock_sem, sem)
 #define prelocked_wait_sem(checker, sem) checker_end_ctx_after_call(checker, _wait_sem, sem, true)
@@ -31,6 +41,7 @@ void _post_sem(Semaphore*);
 // #define delayed_wait_sem(checker, sem) {checker_set_delayed_task(checker, _wait_sem, sem); _lock_sem(sem);}
 #define wait_sem(sem) (_lock_sem(sem), _wait_sem(sem, true))
 #define unalertable_wait_sem(sem) ASSERT((_lock_sem(sem), _wait_sem(sem, false)))
+#define wait_sem_timeout(sem, ms) (_lock_sem(sem), _wait_sem_timeout(sem, true, ms))
 #define post_sem(sem) (_lock_sem(sem), _post_sem(sem), _unlock_sem(sem))
 #define get_sem(sem) ({_lock_sem(sem); bool __ret = _get_sem(sem); _unlock_sem(sem); __ret;})
 
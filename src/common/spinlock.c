@@ -1,23 +1,85 @@
 #include <aarch64/intrinsic.h>
 #include <common/spinlock.h>
+#include <kernel/printk.h>
+
+#ifdef LOCK_STAT
+static LockStat lock_stat[LOCK_STAT_MAX];
+static int lock_stat_cnt;
+#endif
 
 void init_spinlock(SpinLock* lock) {
-    lock->locked = 0;
+    lock->next = 0;
+    lock->owner = 0;
+#ifdef LOCK_STAT
+    lock->stat = NULL;
+#endif
+}
+
+void init_named_spinlock(SpinLock* lock, const char* name) {
+    init_spinlock(lock);
+#ifdef LOCK_STAT
+    int i = __atomic_fetch_add(&lock_stat_cnt, 1, __ATOMIC_RELAXED);
+    if (i < LOCK_STAT_MAX) {
+        lock_stat[i].name = name;
+        lock->stat = &lock_stat[i];
+    }
+#else
+    (void)name;
+#endif
 }
 
 bool _try_acquire_spinlock(SpinLock* lock) {
-    if (!lock->locked && !__atomic_test_and_set(&lock->locked, __ATOMIC_ACQUIRE)) {
-        return true;
-    } else {
+    u32 owner = __atomic_load_n(&lock->owner, __ATOMIC_RELAXED);
+    u32 ticket = owner;
+    // the lock is free iff no ticket is handed out beyond the owner
+    if (!__atomic_compare_exchange_n(&lock->next, &ticket, owner + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
         return false;
-    }
+#ifdef LOCK_STAT
+    if (lock->stat)
+        lock->stat->acquire_cnt++;
+#endif
+    return true;
 }
 
 void _acquire_spinlock(SpinLock* lock) {
-    while (!_try_acquire_spinlock(lock))
+    u32 ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) == ticket) {
+#ifdef LOCK_STAT
+        if (lock->stat)
+            lock->stat->acquire_cnt++;
+#endif
+        return;
+    }
+#ifdef LOCK_STAT
+    u64 t0 = get_timestamp();
+#endif
+    while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket)
         arch_yield();
+#ifdef LOCK_STAT
+    // we own the lock now, so the counters need no atomics
+    if (lock->stat) {
+        lock->stat->acquire_cnt++;
+        lock->stat->contend_cnt++;
+        lock->stat->spin_cycles += get_timestamp() - t0;
+    }
+#endif
 }
 
 void _release_spinlock(SpinLock* lock) {
-    __atomic_clear(&lock->locked, __ATOMIC_RELEASE);
+    // an unbalanced release would serve a ticket nobody holds, and the
+    // lock would be taken by two at once from then on
+    ASSERT(lock->owner != lock->next);
+    __atomic_store_n(&lock->owner, lock->owner + 1, __ATOMIC_RELEASE);
+}
+
+void dump_lock_stat() {
+#ifdef LOCK_STAT
+    int n = MIN(__atomic_load_n(&lock_stat_cnt, __ATOMIC_RELAXED), LOCK_STAT_MAX);
+    for (int i = 0; i < n; i++) {
+        auto s = &lock_stat[i];
+        printk("%s: acquire %llu, contend %llu, spin %llu ticks\n", s->name, s->acquire_cnt, s->contend_cnt, s->spin_cycles);
+    }
+#else
+    printk("lock statistics are disabled, define LOCK_STAT in common/spinlock.h\n");
+#endif
 }
@@ -4,8 +4,26 @@
 #include <aarch64/intrinsic.h>
 #include <common/checker.h>
 
+// Define LOCK_STAT to keep acquisitions, contended acquisitions and spin
+// time for every lock initialized by init_named_spinlock().
+// #define LOCK_STAT
+
+#define LOCK_STAT_MAX 64
+
+typedef struct {
+    const char* name;
+    u64 acquire_cnt;
+    u64 contend_cnt;
+    u64 spin_cycles; // in timer ticks
+} LockStat;
+
+// A ticket lock: waiters are served in FIFO order.
 typedef struct {
-    volatile bool locked;
+    volatile u32 next;  // the next ticket to hand out
+    volatile u32 owner; // the ticket being served
+#ifdef LOCK_STAT
+    LockStat* stat;
+#endif
 } SpinLock;
 
 WARN_RESULT bool _try_acquire_spinlock(SpinLock*);
@@ -15,6 +33,12 @@ void _release_spinlock(SpinLock*);
 // Init a spinlock. It's optional for static objects.
 void init_spinlock(SpinLock*);
 
+// Init a spinlock and record its statistics under the name if LOCK_STAT is on.
+void init_named_spinlock(SpinLock*, const char* name);
+
+// Print the statistics of all named locks.
+void dump_lock_stat();
+
 // Try to acquire a spinlock. Return true on success.
 #define try_acquire_spinlock(checker, lock) (_try_acquire_spinlock(lock) && checker_begin_ctx(checker))
 
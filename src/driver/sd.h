@@ -24,3 +24,7 @@ void sd_init();
 void sd_intr();
 void sd_test();
 void sdrw(buf*);
+
+// queue `b` and return without waiting. `b->end_io` is called from the
+// interrupt handler when the transfer is done, with no lock held.
+void sd_submit(buf* b);
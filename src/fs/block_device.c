@@ -1,34 +1,82 @@
 #include <driver/sd.h>
 #include <fs/block_device.h>
+#include <fs/iosched.h>
 #include <kernel/printk.h>
 
 #define BLOCKNO_OFFSET 0x20800
 
+// requests from all processes go through the elevator, which hands one
+// merged batch at a time to the driver.
+static IOScheduler sd_sched;
+static struct buf sd_batch;
+static u8* sd_batch_vec[IOSCHED_MAX_MERGE];
+
+// called by `sd_intr` when the batch is done.
+static void sd_batch_end(struct buf* b) {
+    (void)b;
+    iosched_done(&sd_sched);
+}
+
+// the blocks are transferred to or from the request buffers directly.
+static void sd_dispatch(IOScheduler* s, IORequest** batch, usize n) {
+    (void)s;
+    u32 k = 0;
+    for (usize i = 0; i < n; i++) {
+        for (usize j = 0; j < batch[i]->count; j++)
+            sd_batch_vec[k++] = batch[i]->buffer + j * BLOCK_SIZE;
+    }
+    sd_batch.blockno = (u32)batch[0]->block_no+BLOCKNO_OFFSET;
+    sd_batch.flags = batch[0]->write ? B_DIRTY | B_VALID : 0;
+    sd_batch.count = k;
+    sd_batch.blocks = NULL;
+    sd_batch.vec = sd_batch_vec;
+    sd_batch.end_io = sd_batch_end;
+    sd_submit(&sd_batch);
+}
+
+// `buffer` must be word-aligned.
+static void sd_rw(usize start, usize count, u8* buffer, bool write) {
+    IORequest req;
+    req.block_no = start;
+    req.count = count;
+    req.buffer = buffer;
+    req.write = write;
+    iosched_rw(&sd_sched, &req);
+}
+
+static void sd_submit_request(IORequest* req) {
+    iosched_submit(&sd_sched, req);
+}
+
 static void sd_read(usize block_no, u8* buffer) {
-    struct buf b;
-    b.blockno = (u32)block_no+BLOCKNO_OFFSET;
-    b.flags = 0;
-    sdrw(&b);
-    memcpy(buffer, b.data, BLOCK_SIZE);
+    sd_rw(block_no, 1, buffer, false);
 }
 
 static void sd_write(usize block_no, u8* buffer) {
-    struct buf b;
-    b.blockno = (u32)block_no+BLOCKNO_OFFSET;
-    b.flags = B_DIRTY | B_VALID;
-    memcpy(b.data, buffer, BLOCK_SIZE);
-    sdrw(&b);
+    sd_rw(block_no, 1, buffer, true);
+}
+
+static void sd_read_blocks(usize start, usize count, u8* buffer) {
+    sd_rw(start, count, buffer, false);
+}
+
+static void sd_write_blocks(usize start, usize count, u8* buffer) {
+    sd_rw(start, count, buffer, true);
 }
 
-static u8 sblock_data[BLOCK_SIZE];
+__attribute__((__aligned__(8))) static u8 sblock_data[BLOCK_SIZE];
 BlockDevice block_device;
 
 void init_block_device() {
     // FIXME
     sd_init();
+    init_iosched(&sd_sched, IOSCHED_ELEVATOR, sd_dispatch);
     sd_read(1, sblock_data);
     block_device.read = sd_read;
     block_device.write = sd_write;
+    block_device.read_blocks = sd_read_blocks;
+    block_device.write_blocks = sd_write_blocks;
+    block_device.submit = sd_submit_request;
 	const SuperBlock* sb = get_super_block();
 	printk("num_blocks: %d\n",sb->num_blocks);
 	printk("num_data_blocks: %d\n", sb->num_data_blocks);
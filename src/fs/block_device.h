@@ -1,6 +1,7 @@
 #pragma once
 
 #include <fs/defines.h>
+#include <fs/iosched.h>
 
 typedef struct {
     // read `BLOCK_SIZE` bytes in block at `block_no` to `buffer`.
@@ -10,6 +11,19 @@ typedef struct {
     // write `BLOCK_SIZE` bytes from `buffer` to block at `block_no`.
     // caller must guarantee `buffer` contains at least `BLOCK_SIZE` bytes.
     void (*write)(usize block_no, u8* buffer);
+
+    // read `count` consecutive blocks from `start` to `buffer` in one
+    // transfer. caller must guarantee `buffer` holds `count * BLOCK_SIZE`
+    // bytes.
+    void (*read_blocks)(usize start, usize count, u8* buffer);
+
+    // write `count` consecutive blocks from `buffer` to `start` in one
+    // transfer.
+    void (*write_blocks)(usize start, usize count, u8* buffer);
+
+    // start the transfer of `req` and return without waiting.
+    // see `iosched_submit`.
+    void (*submit)(IORequest* req);
 } BlockDevice;
 
 extern BlockDevice block_device;
@@ -13,24 +13,86 @@ Semaphore end_sem;
 
 // static SpinLock lock;     // protects block cache.
 // static ListNode head;     // the list of all allocated in-memory block.
-static LogHeader header;  // in-memory copy of log header block.
+static LogHeader header;  // blocks of the running transaction, see `log`.
+
+#define BCACHE_HASH_SIZE 4096
+// the cache grows while more pages than this are free, and shrinks when
+// less than the other are.
+#define BCACHE_GROW_PAGES (REVERSED_PAGES * 8)
+#define BCACHE_SHRINK_PAGES (REVERSED_PAGES * 2)
+
+// 2Q: a block number recently evicted from the queue of new blocks.
+typedef struct Ghost {
+    usize block_no;
+    ListNode node;
+    struct Ghost* hnext;
+} Ghost;
 
 static struct LRUcache {
     SpinLock lock;
     u32 capacity;
+    u32 max_capacity;
     u32 size;
-    ListNode head;
+    int policy;
+    ListNode head;                    // blocks in LRU order, most recent first.
+    Block* hash[BCACHE_HASH_SIZE];    // blocks chained by block_no.
+    // 2Q only: new blocks in FIFO order, and ghosts of the blocks they lost.
+    ListNode fresh;
+    u32 num_fresh;
+    ListNode ghosts;
+    u32 num_ghosts;
+    Ghost* ghost_hash[BCACHE_HASH_SIZE];
+    usize hits, misses, evictions;
 } LRUcache;
 
 // hint: you may need some other variables. Just add them here.
+// there are two transactions at most. the running one takes new ops, while
+// the committing one is written to the log. the last op of a transaction
+// commits it, or, if the log area is still in use, leaves it to the owner of
+// the log area. `header` holds the blocks of the running transaction.
 static struct LOG {
     /* data */
   SpinLock lock;
-  u32 outstanding; 
-  bool committing;  
+  u32 outstanding;  // ops of the running transaction not ended yet.
+  u32 waiting;      // ops of the running transaction ended and waiting.
+  bool committing;  // the log area is used by a commit or a checkpoint.
+  bool closed;      // the running transaction is being handed over to commit,
+                    // no op can join it.
   u32 real_use;
+  usize running;    // sequence number of the running transaction.
+  usize done;       // sequence number of the last committed transaction.
+  usize logical_writes, device_writes;
 } log;
 
+static LogHeader commit_header;  // blocks of the committing transaction.
+
+// asynchronous requests of the cache. the log writer and the checkpoint
+// submit all their writes before waiting, so the device can merge them.
+static struct {
+    usize requests, depth, max_depth;
+} io;
+// the number of clear bits in each bitmap block, so that `alloc` skips the
+// full ones without reading them. a bitmap block is counted when it is
+// scanned for the first time. the count changes with the bitmap block
+// locked.
+#define BCACHE_MAX_BITMAP_BLOCKS 64
+#define BITMAP_FREE_UNKNOWN ((u32)-1)
+static usize num_bitmap_blocks;
+static u32 bitmap_free[BCACHE_MAX_BITMAP_BLOCKS];
+
+// requests of the owner of the log area, which waits for them.
+static IORequest log_io[LOG_MAX_SIZE];
+
+// the log area holds the committed blocks until the flusher checkpoints
+// them. slot i keeps the last committed content of `log_header.block_no[i]`,
+// or is free if the block number is 0. a block committed again takes a free
+// slot, and the new header frees its old one, so repeated updates of a block
+// cost one home write. `log_data` mirrors the slots.
+static LogHeader log_header;
+// the device transfers words, so it is aligned.
+__attribute__((__aligned__(8))) static u8 log_data[LOG_MAX_SIZE][BLOCK_SIZE];
+static Semaphore flush_sem;  // wakes up the flusher.
+
 // read the content from disk.
 static INLINE void device_read(Block* block) {
     device->read(block->block_no, block->data);
@@ -39,6 +101,40 @@ static INLINE void device_read(Block* block) {
 // write the content back to disk.
 static INLINE void device_write(Block* block) {
     device->write(block->block_no, block->data);
+    __atomic_fetch_add(&log.device_writes, 1, __ATOMIC_RELAXED);
+}
+
+static INLINE void write_data(usize block_no, u8* data) {
+    device->write(block_no, data);
+    __atomic_fetch_add(&log.device_writes, 1, __ATOMIC_RELAXED);
+}
+
+// submit `req` for `count` blocks from `block_no`. it must be waited for by
+// `wait_io` unless it has an `end_io`, which must call `end_io_depth`.
+static void submit_io(IORequest* req, usize block_no, usize count, u8* data, bool write) {
+    req->block_no = block_no;
+    req->count = count;
+    req->buffer = data;
+    req->write = write;
+    __atomic_fetch_add(&io.requests, 1, __ATOMIC_RELAXED);
+    usize depth = __atomic_add_fetch(&io.depth, 1, __ATOMIC_RELAXED);
+    usize max_depth = __atomic_load_n(&io.max_depth, __ATOMIC_RELAXED);
+    while (depth > max_depth &&
+           !__atomic_compare_exchange_n(&io.max_depth, &max_depth, depth, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    if (write)
+        __atomic_fetch_add(&log.device_writes, count, __ATOMIC_RELAXED);
+    device->submit(req);
+}
+
+static INLINE void end_io_depth() {
+    __atomic_fetch_sub(&io.depth, 1, __ATOMIC_RELAXED);
+}
+
+static INLINE void wait_io(IORequest* req) {
+    iosched_wait(req);
+    end_io_depth();
 }
 
 // read log header from disk.
@@ -47,28 +143,151 @@ static INLINE void read_header() {
 }
 
 // write log header back to disk.
-static INLINE void write_header() {
-    device->write(sblock->log_start, (u8*)&(header));
+static INLINE void write_header(LogHeader* h) {
+    write_data(sblock->log_start, (u8*)h);
 }
 
 static void init_LRUcache() {
-    init_spinlock(&LRUcache.lock);
+    init_named_spinlock(&LRUcache.lock, "bcache");
     LRUcache.capacity = EVICTION_THRESHOLD;
+    LRUcache.max_capacity = BCACHE_MAX_CAPACITY;
     LRUcache.size = 0;
+    LRUcache.hits = LRUcache.misses = LRUcache.evictions = 0;
+    LRUcache.policy = BCACHE_2Q;
     init_list_node(&LRUcache.head);
+    memset(LRUcache.hash, 0, sizeof(LRUcache.hash));
+    init_list_node(&LRUcache.fresh);
+    LRUcache.num_fresh = 0;
+    init_list_node(&LRUcache.ghosts);
+    LRUcache.num_ghosts = 0;
+    memset(LRUcache.ghost_hash, 0, sizeof(LRUcache.ghost_hash));
+}
+
+// the following 3 functions must hold LRUcache.lock.
+static Block* hash_lookup(usize block_no) {
+    Block* b = LRUcache.hash[block_no % BCACHE_HASH_SIZE];
+    while (b && b->block_no != block_no)
+        b = b->hnext;
+    return b;
+}
+
+static void hash_insert(Block* block) {
+    Block** head = &LRUcache.hash[block->block_no % BCACHE_HASH_SIZE];
+    block->hnext = *head;
+    *head = block;
+}
+
+static void hash_remove(Block* block) {
+    Block** p = &LRUcache.hash[block->block_no % BCACHE_HASH_SIZE];
+    while (*p != block)
+        p = &(*p)->hnext;
+    *p = block->hnext;
 }
 
 static void init_log() {
-    init_spinlock(&log.lock);
+    init_named_spinlock(&log.lock, "log");
     log.outstanding = 0;
+    log.waiting = 0;
     log.committing = false;
+    log.closed = false;
     log.real_use = 0;
+    log.running = 1;
+    log.done = 0;
+    log.logical_writes = log.device_writes = 0;
+}
+
+// the following 3 functions must hold LRUcache.lock.
+static void drop_ghost(Ghost* ghost) {
+    Ghost** p = &LRUcache.ghost_hash[ghost->block_no % BCACHE_HASH_SIZE];
+    while (*p != ghost)
+        p = &(*p)->hnext;
+    *p = ghost->hnext;
+    _detach_from_list(&ghost->node);
+    LRUcache.num_ghosts--;
+    kfree(ghost);
+}
+
+// remember a block evicted from the queue of new blocks. the ghosts are as
+// many as half the capacity at most.
+static void add_ghost(usize block_no) {
+    Ghost* ghost = kalloc(sizeof(Ghost));
+    ghost->block_no = block_no;
+    _insert_into_list(&LRUcache.ghosts, &ghost->node);
+    Ghost** head = &LRUcache.ghost_hash[block_no % BCACHE_HASH_SIZE];
+    ghost->hnext = *head;
+    *head = ghost;
+    LRUcache.num_ghosts++;
+    while (LRUcache.num_ghosts > MAX(LRUcache.capacity / 2, 1u))
+        drop_ghost(container_of(LRUcache.ghosts.prev, Ghost, node));
+}
+
+// drop the ghost of `block_no` and return true if there is one.
+static bool take_ghost(usize block_no) {
+    Ghost* ghost = LRUcache.ghost_hash[block_no % BCACHE_HASH_SIZE];
+    while (ghost && ghost->block_no != block_no)
+        ghost = ghost->hnext;
+    if (ghost)
+        drop_ghost(ghost);
+    return ghost != NULL;
+}
+
+// grow the capacity by one block while memory is plentiful, or shrink it
+// under pressure. must hold LRUcache.lock.
+static void adjust_capacity() {
+    u64 free_pages = left_page_cnt();
+    if (free_pages < BCACHE_SHRINK_PAGES) {
+        LRUcache.capacity = MAX(LRUcache.capacity - LRUcache.capacity / 8, (u32)EVICTION_THRESHOLD);
+    } else if (free_pages > BCACHE_GROW_PAGES && LRUcache.size > LRUcache.capacity &&
+               LRUcache.capacity < LRUcache.max_capacity) {
+        LRUcache.capacity++;
+    }
+}
+
+// the oldest block of `list` that is neither pinned nor acquired.
+static Block* find_victim(ListNode* list) {
+    for (ListNode* node = list->prev; node != list; node = node->prev) {
+        Block* b = container_of(node, Block, node);
+        if (!b->pinned && !b->acquired)
+            return b;
+    }
+    return NULL;
+}
+
+// evict unused blocks until the cache fits in its capacity. 2Q takes them
+// from the queue of new blocks while it holds more than a quarter of the
+// cache. return the number of blocks evicted. must hold LRUcache.lock.
+static usize evict_blocks() {
+    usize n = 0;
+    while (LRUcache.size > LRUcache.capacity) {
+        Block* b = NULL;
+        if (LRUcache.num_fresh > LRUcache.capacity / 4)
+            b = find_victim(&LRUcache.fresh);
+        if (b == NULL)
+            b = find_victim(&LRUcache.head);
+        if (b == NULL)
+            b = find_victim(&LRUcache.fresh);
+        if (b == NULL)
+            break;
+        _detach_from_list(&b->node);
+        hash_remove(b);
+        if (!b->hot) {
+            LRUcache.num_fresh--;
+            add_ghost(b->block_no);
+        }
+        LRUcache.size--;
+        LRUcache.evictions++;
+        kfree(b);
+        n++;
+    }
+    return n;
 }
 
 // initialize a block struct.
 static void init_block(Block* block) {
     block->block_no = 0;
     init_list_node(&block->node);
+    block->hnext = NULL;
+    block->refs = 0;
     block->acquired = false;
     block->pinned = false;
 
@@ -82,63 +301,140 @@ static usize get_num_cached_blocks() {
     return LRUcache.size;
 }
 
-// see `cache.h`.
-static Block* cache_acquire(usize block_no) {
-    // TODO
+// cache a new block for `block_no`, acquired but not read yet. must hold
+// the lock of the block cache.
+static Block* insert_block(usize block_no) {
+    //kalloc一个新的block
+    LRUcache.misses++;
+    Block* block = kalloc(sizeof(Block));
+    init_block(block);
+    block->hot = LRUcache.policy == BCACHE_LRU || take_ghost(block_no);
+    if (block->hot) {
+        _insert_into_list(&LRUcache.head, &block->node);
+    } else {
+        _insert_into_list(&LRUcache.fresh, &block->node);
+        LRUcache.num_fresh++;
+    }
+    LRUcache.size++;
+    block->block_no = block_no;
+    hash_insert(block);
+    block->acquired = true;
+    return block;
+}
+
+// lock the block at `block_no`, and read it from disk if it is not cached
+// and `read` is true. otherwise a new block is zeroed.
+static Block* acquire_block(usize block_no, bool read) {
     _acquire_spinlock(&LRUcache.lock);
 
     //判断cache中是否存在
-    _for_in_list(node, &LRUcache.head) {
-        if (node == &LRUcache.head) {
-            continue;
-        }
-        Block* b = container_of(node, Block, node);
-        if (b->block_no == block_no) {
-
-            b->acquired = true;
-            _lock_sem(&b->lock);
-            _release_spinlock(&LRUcache.lock);
-            ASSERT(_wait_sem(&b->lock, false));
+    Block* b = hash_lookup(block_no);
+    if (b) {
+        LRUcache.hits++;
+        b->acquired = true;
+        _lock_sem(&b->lock);
+        _release_spinlock(&LRUcache.lock);
+        ASSERT(_wait_sem(&b->lock, false));
 
-            _acquire_spinlock(&LRUcache.lock);
-            b->acquired = true;
+        _acquire_spinlock(&LRUcache.lock);
+        b->acquired = true;
 
-            _detach_from_list(node);
-            _insert_into_list(&LRUcache.head, node);
+        // a new block stays in its FIFO queue until it proves to be hot.
+        if (!b->hot && ++b->refs >= 2) {
+            b->hot = true;
+            LRUcache.num_fresh--;
+        }
+        if (b->hot) {
+            _detach_from_list(&b->node);
+            _insert_into_list(&LRUcache.head, &b->node);
+        }
 
-            _release_spinlock(&LRUcache.lock);
+        _release_spinlock(&LRUcache.lock);
 
-            return b;
-        }
+        return b;
     }
 
-    //kalloc一个新的block
-    Block* block = kalloc(sizeof(Block));
-    init_block(block);
-    _insert_into_list(&LRUcache.head, &block->node);
-    LRUcache.size++;
-    block->block_no = block_no;
-    block->acquired = true;
+    Block* block = insert_block(block_no);
     _lock_sem(&block->lock);
     _release_spinlock(&LRUcache.lock);
     ASSERT(_wait_sem(&block->lock, false));
-    device_read(block);
+    if (read)
+        device_read(block);
+    else
+        memset(block->data, 0, BLOCK_SIZE);
     block->valid = true;
 
     _acquire_spinlock(&LRUcache.lock);
-    if (LRUcache.size > LRUcache.capacity) {
-        ListNode* replace_node = LRUcache.head.prev;
-        if (!container_of(replace_node, Block, node)->pinned && !container_of(replace_node, Block, node)->acquired) {
-            Block* replace_block = container_of(replace_node, Block, node);
-        
-            _detach_from_list(replace_node);
-            LRUcache.size--;
-            kfree(replace_block);
-        }
+    adjust_capacity();
+    evict_blocks();
+    _release_spinlock(&LRUcache.lock);
+    return block;
+}
+
+// see `cache.h`.
+static Block* cache_acquire(usize block_no) {
+    // TODO
+    return acquire_block(block_no, true);
+}
+
+// see `cache.h`.
+static Block* cache_acquire_new(usize block_no) {
+    return acquire_block(block_no, false);
+}
+
+// see `cache.h`.
+void get_bcache_stat(BlockCacheStat* stat) {
+    _acquire_spinlock(&LRUcache.lock);
+    stat->hits = LRUcache.hits;
+    stat->misses = LRUcache.misses;
+    stat->evictions = LRUcache.evictions;
+    stat->num_cached = LRUcache.size;
+    stat->capacity = LRUcache.capacity;
+    stat->max_capacity = LRUcache.max_capacity;
+    _release_spinlock(&LRUcache.lock);
+    _acquire_spinlock(&log.lock);
+    stat->logical_writes = log.logical_writes;
+    stat->device_writes = log.device_writes;
+    _release_spinlock(&log.lock);
+    stat->io_requests = __atomic_load_n(&io.requests, __ATOMIC_RELAXED);
+    stat->io_depth = __atomic_load_n(&io.depth, __ATOMIC_RELAXED);
+    stat->max_io_depth = __atomic_load_n(&io.max_depth, __ATOMIC_RELAXED);
+}
+
+// see `cache.h`.
+void set_bcache_policy(int policy) {
+    _acquire_spinlock(&LRUcache.lock);
+    // all the new blocks join the main queue, behind the blocks already there.
+    while (!_empty_list(&LRUcache.fresh)) {
+        Block* b = container_of(LRUcache.fresh.next, Block, node);
+        _detach_from_list(&b->node);
+        _insert_into_list(LRUcache.head.prev, &b->node);
+        b->hot = true;
     }
+    LRUcache.num_fresh = 0;
+    while (!_empty_list(&LRUcache.ghosts))
+        drop_ghost(container_of(LRUcache.ghosts.next, Ghost, node));
+    LRUcache.policy = policy;
+    _release_spinlock(&LRUcache.lock);
+}
 
+// see `cache.h`.
+void set_bcache_max_capacity(usize max_capacity) {
+    _acquire_spinlock(&LRUcache.lock);
+    LRUcache.max_capacity = MAX(max_capacity, (usize)EVICTION_THRESHOLD);
+    LRUcache.capacity = MIN(LRUcache.capacity, LRUcache.max_capacity);
+    evict_blocks();
     _release_spinlock(&LRUcache.lock);
-    return block;
+}
+
+// see `cache.h`.
+usize reclaim_bcache(usize num_blocks) {
+    _acquire_spinlock(&LRUcache.lock);
+    usize target = LRUcache.size > num_blocks ? LRUcache.size - num_blocks : 0;
+    LRUcache.capacity = MAX(MIN((usize)LRUcache.capacity, target), (usize)EVICTION_THRESHOLD);
+    usize n = evict_blocks();
+    _release_spinlock(&LRUcache.lock);
+    return n;
 }
 
 // see `cache.h`.
@@ -154,25 +450,64 @@ static void cache_release(Block* block) {
     _release_spinlock(&LRUcache.lock);
 }
 
+// the prefetch of `req->arg` is complete.
+static void prefetch_end(IORequest* req) {
+    Block* block = req->arg;
+    block->valid = true;
+    end_io_depth();
+    cache_release(block);
+}
+
+// see `cache.h`.
+static void cache_prefetch(usize block_no) {
+    _acquire_spinlock(&LRUcache.lock);
+    if (hash_lookup(block_no)) {
+        _release_spinlock(&LRUcache.lock);
+        return;
+    }
+    Block* block = insert_block(block_no);
+    _lock_sem(&block->lock);
+    _release_spinlock(&LRUcache.lock);
+    ASSERT(_wait_sem(&block->lock, false));
+
+    _acquire_spinlock(&LRUcache.lock);
+    adjust_capacity();
+    evict_blocks();
+    _release_spinlock(&LRUcache.lock);
+
+    // readers of the block wait for its lock, which `prefetch_end` releases.
+    block->io.end_io = prefetch_end;
+    block->io.arg = block;
+    submit_io(&block->io, block_no, 1, block->data, false);
+}
+
+// the number of slots in the log area.
+static INLINE usize log_limit() {
+    return MIN(sblock->num_log_blocks - 1, (usize)LOG_MAX_SIZE);
+}
+
+// the number of ops that can still begin. must hold log.lock.
+static INLINE int log_room() {
+    usize limit = log_limit();
+    if (log.real_use + OP_MAX_NUM_BLOCKS > limit)
+        return 0;
+    return (limit - log.real_use) / OP_MAX_NUM_BLOCKS;
+}
+
 // see `cache.h`.
 static void cache_begin_op(OpContext* ctx) {
     // TODO
     while (1) {
         _acquire_spinlock(&log.lock);
-        if (log.committing) {
+        if (log.closed || log_room() == 0) {
             _lock_sem(&begin_sem);
             _release_spinlock(&log.lock);
             ASSERT(_wait_sem(&begin_sem, false));
         }
-        else if ((log.real_use + OP_MAX_NUM_BLOCKS > sblock->num_log_blocks - 1) || (log.real_use + OP_MAX_NUM_BLOCKS > LOG_MAX_SIZE)) {
-            _lock_sem(&begin_sem);
-            _release_spinlock(&log.lock);
-            ASSERT(_wait_sem(&begin_sem, false));
-            // unalertable_wait_sem(&begin_sem);
-        }
         else {
             log.outstanding++;
             ctx->rm = OP_MAX_NUM_BLOCKS;
+            ctx->ts = log.running;
             log.real_use += OP_MAX_NUM_BLOCKS;
             _release_spinlock(&log.lock);
             break;
@@ -190,6 +525,7 @@ static void cache_sync(OpContext* ctx, Block* block) {
         _acquire_spinlock(&log.lock);
         _acquire_spinlock(&LRUcache.lock);
         block->pinned = true;
+        log.logical_writes++;
         usize i;
         for (i = 0; i < header.num_blocks; i++) {
             if (header.block_no[i] == block->block_no)   
@@ -210,57 +546,186 @@ static void cache_sync(OpContext* ctx, Block* block) {
     }
 }
 
+// sleep on `end_sem` until it is posted. must hold log.lock, which is
+// held again on return.
+static void wait_log() {
+    _lock_sem(&end_sem);
+    _release_spinlock(&log.lock);
+    ASSERT(_wait_sem(&end_sem, false));
+    _acquire_spinlock(&log.lock);
+}
+
+static bool in_running(usize block_no) {
+    for (usize i = 0; i < header.num_blocks; i++) {
+        if (header.block_no[i] == block_no)
+            return true;
+    }
+    return false;
+}
+
+static usize used_slots() {
+    usize n = 0;
+    for (usize i = 0; i < log_header.num_blocks; i++) {
+        if (log_header.block_no[i])
+            n++;
+    }
+    return n;
+}
+
+// write the blocks in the log area to their home locations, and empty it.
+// must own the log area.
+static void checkpoint() {
+    usize n = log_header.num_blocks;
+    if (n == 0)
+        return;
+    //log -> sd
+    for (usize i = 0; i < n; i++) {
+        if (log_header.block_no[i])
+            submit_io(&log_io[i], log_header.block_no[i], 1, log_data[i], true);
+    }
+    for (usize i = 0; i < n; i++) {
+        if (log_header.block_no[i])
+            wait_io(&log_io[i]);
+    }
+
+    // blocks logged again by the running transaction stay pinned.
+    _acquire_spinlock(&log.lock);
+    _acquire_spinlock(&LRUcache.lock);
+    for (usize i = 0; i < n; i++) {
+        Block* b = hash_lookup(log_header.block_no[i]);
+        if (b && !in_running(b->block_no))
+            b->pinned = false;
+        log_header.block_no[i] = 0;
+    }
+    log_header.num_blocks = 0;
+    _release_spinlock(&LRUcache.lock);
+    _release_spinlock(&log.lock);
+    write_header(&log_header);
+}
+
+// commit the running transaction. must hold log.lock and own the log area.
+// the lock is released during I/O.
+static void commit_running() {
+    log.closed = true;
+    if (log_limit() - used_slots() < header.num_blocks) {
+        // no op is running, so the transaction can not grow meanwhile.
+        _release_spinlock(&log.lock);
+        checkpoint();
+        _acquire_spinlock(&log.lock);
+    }
+    commit_header.num_blocks = header.num_blocks;
+    memmove(commit_header.block_no, header.block_no, header.num_blocks * sizeof(usize));
+    header.num_blocks = 0;
+    log.real_use = 0;
+    log.waiting = 0;
+    usize seq = log.running++;
+    _release_spinlock(&log.lock);
+
+    // no op is running, so the snapshot sees every op of the transaction
+    // and none of the next one.
+    usize n = commit_header.num_blocks;
+    usize slot[LOG_MAX_SIZE];
+    for (usize i = 0, j = 0; i < n; i++, j++) {
+        while (log_header.block_no[j])
+            j++;
+        slot[i] = j;
+        Block* b = cache_acquire(commit_header.block_no[i]);
+        memmove(log_data[j], b->data, BLOCK_SIZE);
+        cache_release(b);
+    }
+
+    // new ops join the next transaction while this one is written.
+    _acquire_spinlock(&log.lock);
+    log.closed = false;
+    wake_sem(&begin_sem, log_room());
+    _release_spinlock(&log.lock);
+
+    if (n > 0) {
+        // slots are taken in order, so adjacent ones go in one transfer.
+        usize runs = 0;
+        for (usize i = 0, k; i < n; i += k) {
+            for (k = 1; i + k < n && slot[i + k] == slot[i] + k; k++)
+                ;
+            submit_io(&log_io[runs++], sblock->log_start + 1 + slot[i], k,
+                      log_data[slot[i]], true);
+        }
+        for (usize i = 0; i < runs; i++)
+            wait_io(&log_io[i]);
+        for (usize i = 0; i < n; i++) {
+            for (usize j = 0; j < log_header.num_blocks; j++) {
+                if (log_header.block_no[j] == commit_header.block_no[i])
+                    log_header.block_no[j] = 0;
+            }
+            log_header.block_no[slot[i]] = commit_header.block_no[i];
+            log_header.num_blocks = MAX(log_header.num_blocks, slot[i] + 1);
+        }
+        write_header(&log_header);
+        commit_header.num_blocks = 0;
+        if (used_slots() > log_limit() / 2)
+            post_sem(&flush_sem);
+    }
+
+    _acquire_spinlock(&log.lock);
+    log.done = seq;
+    post_all_sem(&end_sem);
+}
+
+// take the log area. must hold log.lock.
+static void own_log() {
+    while (log.committing)
+        wait_log();
+    log.committing = true;
+}
+
+// give up the log area, after committing the transactions ended while it
+// was in use. must hold log.lock.
+static void release_log() {
+    while (log.outstanding == 0 && log.waiting > 0)
+        commit_running();
+    log.committing = false;
+    post_all_sem(&end_sem);
+}
+
 // see `cache.h`.
 static void cache_end_op(OpContext* ctx) {
     // TODO
     _acquire_spinlock(&log.lock);
     log.outstanding--;
     log.real_use -= ctx->rm;
-        
-    if(log.outstanding == 0) {
-        log.committing = true;
+
+    if (log.outstanding > 0 || log.committing) {
+        log.waiting++;
+        wake_sem(&begin_sem, log_room());
+        while (log.done < ctx->ts)
+            wait_log();
         _release_spinlock(&log.lock);
-        // _acquire_spinlock(&log.lock_2);
-        //write_log
-        for (usize i = 0; i < header.num_blocks; i++) {
-            Block* from_b = cache_acquire(header.block_no[i]);
-            Block* to_b = cache_acquire(sblock->log_start + 1 + i);
-            memmove(to_b->data, from_b->data, BLOCK_SIZE);
-            device_write(to_b);
-            cache_release(from_b);
-            cache_release(to_b);
-        }
-        
-        write_header();
+        return;
+    }
 
-        //log -> sd
-        for (usize i = 0; i < header.num_blocks; i++) {
-            Block* from_b = cache_acquire(sblock->log_start + 1 + i);
-            Block* to_b = cache_acquire(header.block_no[i]);
-            memmove(to_b->data, from_b->data, BLOCK_SIZE);
-            device_write(to_b);
-            to_b->pinned = false;
-            cache_release(from_b);
-            cache_release(to_b);
-        }
-        
-        header.num_blocks = 0;
-        write_header();
-        // _release_spinlock(&log.lock_2);
+    log.committing = true;
+    commit_running();
+    release_log();
+    _release_spinlock(&log.lock);
+}
 
-        _acquire_spinlock(&log.lock);
-        log.committing = false;
-        log.real_use = 0;
-        _release_spinlock(&log.lock);
+// see `cache.h`.
+void checkpoint_log() {
+    _acquire_spinlock(&log.lock);
+    own_log();
+    _release_spinlock(&log.lock);
+    checkpoint();
+    _acquire_spinlock(&log.lock);
+    release_log();
+    _release_spinlock(&log.lock);
+}
 
-        post_all_sem(&begin_sem);
-        post_all_sem(&end_sem);
+// see `cache.h`.
+void log_flusher(u64 arg) {
+    (void)arg;
+    while (1) {
+        unalertable_wait_sem(&flush_sem);
+        checkpoint_log();
     }
-    else {
-        post_all_sem(&begin_sem);
-        _release_spinlock(&log.lock);
-        unalertable_wait_sem(&end_sem);
-    }    
 }
 
 // initialize block cache.
@@ -273,50 +738,119 @@ void init_bcache(const SuperBlock* _sblock, const BlockDevice* _device) {
     init_log();
     init_sem(&begin_sem, 0);
     init_sem(&end_sem, 0);
+    init_sem(&flush_sem, 0);
+    memset(&log_header, 0, sizeof(log_header));
+    memset(&io, 0, sizeof(io));
+    num_bitmap_blocks = (sblock->num_blocks + BIT_PER_BLOCK - 1) / BIT_PER_BLOCK;
+    ASSERT(num_bitmap_blocks <= BCACHE_MAX_BITMAP_BLOCKS);
+    for (usize i = 0; i < num_bitmap_blocks; i++)
+        bitmap_free[i] = BITMAP_FREE_UNKNOWN;
 
     _acquire_spinlock(&log.lock);
     read_header();
     if (header.num_blocks > 0) {
+        device->read_blocks(sblock->log_start + 1, header.num_blocks, (u8*)log_data);
         for (usize i = 0; i < header.num_blocks; i++) {
-            Block* from_b = cache_acquire(sblock->log_start + 1 + i);
-            Block* to_b = cache_acquire(header.block_no[i]);
-            memmove(to_b->data, from_b->data, BLOCK_SIZE);
-            device_write(to_b);
-            cache_release(from_b);
-            cache_release(to_b);
+            if (header.block_no[i])
+                write_data(header.block_no[i], log_data[i]);
         }
     }
 
     header.num_blocks = 0;
-    write_header();
+    write_header(&header);
     _release_spinlock(&log.lock);
 }
 
+// the first clear bit of the bitmap block `b` from bit `from`, among its
+// first `num_bits` bits, or `BIT_PER_BLOCK` if there is none. it reads 64
+// bits at a time.
+static usize find_clear_bit(Block* b, usize from, usize num_bits) {
+    u64* words = (u64*)b->data;
+    for (usize k = from / 64; k * 64 < num_bits; k++) {
+        u64 w = ~words[k];
+        if (k == from / 64)
+            w &= ~0ull << (from % 64);
+        if (num_bits - k * 64 < 64)
+            w &= BIT(num_bits - k * 64) - 1;
+        if (w)
+            return k * 64 + (usize)__builtin_ctzll(w);
+    }
+    return BIT_PER_BLOCK;
+}
+
+// the number of clear bits among the first `num_bits` bits of `b`.
+static u32 count_clear_bits(Block* b, usize num_bits) {
+    u64* words = (u64*)b->data;
+    u32 n = 0;
+    for (usize k = 0; k * 64 < num_bits; k++) {
+        u64 w = ~words[k];
+        if (num_bits - k * 64 < 64)
+            w &= BIT(num_bits - k * 64) - 1;
+        n += (u32)__builtin_popcountll(w);
+    }
+    return n;
+}
+
 // see `cache.h`.
 // hint: you can use `cache_acquire`/`cache_sync` to read/write blocks.
-static usize cache_alloc(OpContext* ctx) {
+static usize cache_alloc_run(OpContext* ctx, usize goal, usize* count) {
     // TODO
-    for (u32 i = 0; i < sblock->num_blocks; i += BIT_PER_BLOCK) {
-        Block* bp_b = cache_acquire(i / BIT_PER_BLOCK + sblock->bitmap_start);
-
-        for (u32 j = 0; j < BIT_PER_BLOCK && i + j < sblock->num_blocks-SWAP_BLOCK_NUM; j++) {
-            u8 m = 1 << (j % 8);
-            if (!(bp_b->data[j / 8] & m)) {
-                bp_b->data[j / 8] |= m;
-                cache_sync(ctx, bp_b);
-                cache_release(bp_b);
-                Block* target_b = cache_acquire(i + j);
-                memset(target_b->data, 0, BLOCK_SIZE);
-                cache_sync(ctx, target_b);
-                cache_release(target_b);
-                return (i + j);
-            } 
+    ASSERT(*count > 0);
+    usize limit = sblock->num_blocks - SWAP_BLOCK_NUM;
+    if (goal >= limit)
+        goal = 0;
+    usize first = goal / BIT_PER_BLOCK;
+    // the bitmap block of the goal comes first and last, to look at the
+    // bits before the goal at last.
+    for (usize n = 0; n <= num_bitmap_blocks; n++) {
+        usize i = (first + n) % num_bitmap_blocks;
+        usize base = i * BIT_PER_BLOCK;
+        if (base >= limit || __atomic_load_n(&bitmap_free[i], __ATOMIC_RELAXED) == 0)
+            continue;
+
+        Block* bp_b = cache_acquire(sblock->bitmap_start + i);
+        usize num_bits = MIN((usize)BIT_PER_BLOCK, limit - base);
+        if (bitmap_free[i] == BITMAP_FREE_UNKNOWN)
+            bitmap_free[i] = count_clear_bits(bp_b, num_bits);
+        usize j = find_clear_bit(bp_b, n == 0 ? goal % BIT_PER_BLOCK : 0, num_bits);
+        if (j == BIT_PER_BLOCK) {
+            cache_release(bp_b);
+            continue;
         }
+
+        // take the clear bits after the first one too, up to `*count`.
+        usize len = 0;
+        do {
+            bp_b->data[(j + len) / 8] |= (u8)(1 << ((j + len) % 8));
+            len++;
+        } while (len < *count && j + len < num_bits &&
+                 !(bp_b->data[(j + len) / 8] & (1 << ((j + len) % 8))));
+        bitmap_free[i] -= (u32)len;
+        cache_sync(ctx, bp_b);
         cache_release(bp_b);
+        *count = len;
+        return base + j;
     }
     PANIC();
 }
 
+// see `cache.h`.
+static usize cache_alloc_near(OpContext* ctx, usize goal) {
+    usize count = 1;
+    usize block_no = cache_alloc_run(ctx, goal, &count);
+    // the stale content is never read, it is overwritten by zeros.
+    Block* target_b = cache_acquire_new(block_no);
+    memset(target_b->data, 0, BLOCK_SIZE);
+    cache_sync(ctx, target_b);
+    cache_release(target_b);
+    return block_no;
+}
+
+// see `cache.h`.
+static usize cache_alloc(OpContext* ctx) {
+    return cache_alloc_near(ctx, 0);
+}
+
 // see `cache.h`.
 // hint: you can use `cache_acquire`/`cache_sync` to read/write blocks.
 static void cache_free(OpContext* ctx, usize block_no) {
@@ -327,6 +861,9 @@ static void cache_free(OpContext* ctx, usize block_no) {
         PANIC();
     }
     bp_b->data[(block_no % BIT_PER_BLOCK) / 8] &= ~m;
+    usize i = block_no / BIT_PER_BLOCK;
+    if (bitmap_free[i] != BITMAP_FREE_UNKNOWN)
+        bitmap_free[i]++;
     cache_sync(ctx, bp_b);
     cache_release(bp_b);
 }
@@ -361,10 +898,14 @@ u32 find_and_set_8_blocks() {
 BlockCache bcache = {
     .get_num_cached_blocks = get_num_cached_blocks,
     .acquire = cache_acquire,
+    .acquire_new = cache_acquire_new,
     .release = cache_release,
+    .prefetch = cache_prefetch,
     .begin_op = cache_begin_op,
     .sync = cache_sync,
     .end_op = cache_end_op,
     .alloc = cache_alloc,
+    .alloc_near = cache_alloc_near,
+    .alloc_run = cache_alloc_run,
     .free = cache_free,
 };
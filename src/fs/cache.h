@@ -9,24 +9,44 @@
 
 // if the number of cached blocks is no less than this threshold, we can
 // evict some blocks in `acquire` to keep block cache small.
+// the cache never shrinks below this threshold.
 #define EVICTION_THRESHOLD 20
 
+// replacement policies of the block cache.
+// BCACHE_LRU: evict the least recently used block.
+// BCACHE_2Q: new blocks wait in a FIFO queue. they join the main LRU queue
+// when referenced again after leaving it, or referenced twice more while in
+// it, which is more than a log commit does. a scan touches each block once,
+// so it can not push hot blocks out.
+#define BCACHE_LRU 0
+#define BCACHE_2Q 1
+
+// the cache grows up to this many blocks at boot while free pages are
+// plentiful. it can be changed later by `set_bcache_max_capacity`.
+#define BCACHE_MAX_CAPACITY 8192
+
 // hint: `cache_test` only requires `block_no`, `valid` and `data` are present
 // in this struct. All other struct members can be customized by yourself.
 // for example, if you want to implement LFU strategy instead, you can add a
 // counter inside `Block` to maintain the number of times it was accessed.
-typedef struct {
-    // accesses to the following 4 members should be guarded by the lock
+typedef struct Block {
+    // accesses to the following 7 members should be guarded by the lock
     // of the block cache.
     usize block_no;
     ListNode node;
+    struct Block* hnext;  // next block in the same hash bucket.
+    bool hot;             // on the main queue rather than the queue of new
+                          // blocks, see `BCACHE_2Q`.
+    u32 refs;             // references while on the queue of new blocks.
     bool acquired;  // is the block already acquired by some thread?
     bool pinned;    // if a block is pinned, it should not be evicted from the
                     // cache.
     Semaphore sem;  // this lock protects `valid` and `data`.
     SleepLock lock;
     bool valid;  // is the content of block loaded from disk?
-    u8 data[BLOCK_SIZE];
+    IORequest io;  // reads the block in background, see `prefetch`.
+    // the device transfers to and from `data` directly, so it is aligned.
+    __attribute__((__aligned__(8))) u8 data[BLOCK_SIZE];
 } Block;
 
 // `OpContext` represents an atomic operation.
@@ -48,20 +68,35 @@ typedef struct BlockCache {
     // return the pointer to the locked block.
     Block* (*acquire)(usize block_no);
 
+    // like `acquire`, for a block that the caller is going to overwrite
+    // entirely, e.g. a newly allocated one. if it is not cached, it is not
+    // read from disk, and it is zeroed instead.
+    Block* (*acquire_new)(usize block_no);
+
     // unlock `block`.
     // NOTE: it does not need to write the block content back to disk.
     void (*release)(Block* block);
 
+    // read the block at `block_no` into the cache if it is not cached yet,
+    // without keeping it locked. it is a hint used by read-ahead.
+    // the read is submitted without waiting, and the block stays locked
+    // until it completes.
+    void (*prefetch)(usize block_no);
+
     // NOTES FOR ATOMIC OPERATIONS
     //
     // atomic operation has three states:
     // * running: this atomic operation may have more modifications.
     // * committed: this atomic operation is ended. No more modifications.
-    // * checkpointed: all modifications have been already persisted to disk.
+    //   its modifications are persisted in the log.
+    // * checkpointed: all modifications have been already persisted to their
+    //   home locations on disk.
     //
     // `begin_op` creates a new running atomic operation.
     // `end_op` commits an atomic operation, and waits for it to be
-    // checkpointed.
+    // committed. it is checkpointed later by `checkpoint_log`, which the
+    // flusher thread runs when the log is half full, or by a commit that
+    // finds no room in the log.
 
     // begin a new atomic operation and initialize `ctx`.
     // `OpContext` represents an outstanding atomic operation. You can mark the
@@ -81,7 +116,7 @@ typedef struct BlockCache {
     void (*sync)(OpContext* ctx, Block* block);
 
     // end the atomic operation managed by `ctx`.
-    // it returns when all associated blocks are persisted to disk.
+    // it returns when all associated blocks are persisted to the log.
     void (*end_op)(OpContext* ctx);
 
     // NOTES FOR BITMAP
@@ -99,22 +134,59 @@ typedef struct BlockCache {
     // NOTE: if there's no free block on disk, `alloc` should panic.
     usize (*alloc)(OpContext* ctx);
 
+    // like `alloc`, but take the first free block from `goal` on, wrapping
+    // around to the start of the disk. a file passes the block after its
+    // last one, so that it stays contiguous.
+    usize (*alloc_near)(OpContext* ctx, usize goal);
+
+    // like `alloc_near`, but allocate a run of up to `*count` contiguous
+    // blocks and set `*count` to its length, which is at least one. the
+    // blocks are NOT zeroed, and the caller must overwrite them.
+    usize (*alloc_run)(OpContext* ctx, usize goal, usize* count);
+
     // mark block at `block_no` is free in bitmap.
     void (*free)(OpContext* ctx, usize block_no);
 } BlockCache;
 
 extern BlockCache bcache;
 
+typedef struct {
+    usize hits;
+    usize misses;
+    usize evictions;
+    usize num_cached;
+    usize capacity;      // the current capacity, adapted to free memory.
+    usize max_capacity;
+    usize logical_writes;  // blocks synced by atomic operations.
+    usize device_writes;   // blocks written to the device.
+    usize io_requests;     // asynchronous requests submitted.
+    usize io_depth;        // asynchronous requests not completed yet.
+    usize max_io_depth;
+} BlockCacheStat;
+
+void get_bcache_stat(BlockCacheStat* stat);
+void set_bcache_policy(int policy);
+void set_bcache_max_capacity(usize max_capacity);
+// evict up to `num_blocks` unused blocks under memory pressure.
+// return the number of blocks evicted.
+usize reclaim_bcache(usize num_blocks);
+
+// write every committed block to its home location, and empty the log.
+void checkpoint_log();
+// the body of the flusher thread, which checkpoints the log in background.
+void log_flusher(u64 arg);
+
 void init_bcache(const SuperBlock* sblock, const BlockDevice* device);
 usize BBLOCK(usize block_no, const SuperBlock* sb);
 void bzero(OpContext* ctx, u32 block_no);
 
 #define SWAP_BLOCK_NUM 200
 #define SWAP_PAGE_NUM (SWAP_BLOCK_NUM/8)
-#define SWAP_START 800
-#define SWAP_END 1000
-#define SWAP_BIT_START 100
-#define SWAP_BIT_END 125
+// the swap area is at the end of the filesystem.
+#define SWAP_START (FSSIZE - SWAP_BLOCK_NUM)
+#define SWAP_END FSSIZE
+#define SWAP_BIT_START (SWAP_START / 8)
+#define SWAP_BIT_END (SWAP_END / 8)
 bool swap_used[SWAP_PAGE_NUM];
 SpinLock swap_lk;
 void release_8_blocks(u32 bno);
@@ -12,10 +12,12 @@
 // maximum number of distinct block numbers can be recorded in the log header.
 #define LOG_MAX_SIZE ((BLOCK_SIZE - sizeof(usize)) / sizeof(usize))
 
-#define INODE_NUM_DIRECT   12
+#define INODE_NUM_DIRECT   11
 #define INODE_NUM_INDIRECT (BLOCK_SIZE / sizeof(u32))
+// blocks mapped through the double indirect block.
+#define INODE_NUM_DOUBLE   (INODE_NUM_INDIRECT * INODE_NUM_INDIRECT)
 #define INODE_PER_BLOCK    (BLOCK_SIZE / sizeof(InodeEntry))
-#define INODE_MAX_BLOCKS   (INODE_NUM_DIRECT + INODE_NUM_INDIRECT)
+#define INODE_MAX_BLOCKS   (INODE_NUM_DIRECT + INODE_NUM_INDIRECT + INODE_NUM_DOUBLE)
 #define INODE_MAX_BYTES    (INODE_MAX_BLOCKS * BLOCK_SIZE)
 
 // the maximum length of file names, including trailing '\0'.
@@ -57,9 +59,11 @@ typedef struct dinode {
     u32 num_bytes;                // number of bytes in the file, i.e. the size of file.
     u32 addrs[INODE_NUM_DIRECT];  // direct addresses/block numbers.
     u32 indirect;                 // the indirect address block.
+    u32 double_indirect;          // the block of indirect address blocks.
 } InodeEntry;
 
-// the block pointed by `InodeEntry.indirect`.
+// the block pointed by `InodeEntry.indirect`, and by `double_indirect` and
+// each of its entries.
 typedef struct {
     u32 addrs[INODE_NUM_INDIRECT];
 } IndirectBlock;
@@ -70,10 +74,60 @@ typedef struct dirent {
     char name[FILE_NAME_MAX_LENGTH];
 } DirEntry;
 
+// entries in a directory block.
+#define DIR_PER_BLOCK (BLOCK_SIZE / sizeof(DirEntry))
+
+// indexed directories.
+//
+// a directory is an array of `DirEntry` until it fills
+// `DIR_LINEAR_MAX_BLOCKS` blocks. then it is indexed: the first two entries
+// stay in block 0, and the rest of block 0 becomes the root of a hash tree.
+// the other blocks are index nodes, or leaves holding the entries. a name
+// lives in the leaf whose range covers `dir_hash(name)`, and a hash never
+// spans two leaves.
+//
+// every record of an index node has a zero `inode_no`, so the nodes read as
+// free entries to readers of the linear format.
+#define DIR_LINEAR_MAX_BLOCKS 2
+#define DX_MAGIC 0x78656478  // "xdex"
+#define DX_ROOT_OFFSET (2 * sizeof(DirEntry))
+// entries of the root, and of the other index nodes.
+#define DX_ROOT_ENTRIES (BLOCK_SIZE / sizeof(DxEntry) - 3)
+#define DX_NODE_ENTRIES (BLOCK_SIZE / sizeof(DxEntry) - 1)
+// at most this many levels of index nodes are under the root.
+#define DX_MAX_LEVELS 1
+
+// the first record of an index node.
+typedef struct {
+    u16 zero;
+    u16 count;   // number of `DxEntry` that follow.
+    u32 magic;   // `DX_MAGIC`, in the root only.
+    u32 levels;  // levels of index nodes under the root, in the root only.
+    u32 unused;
+} DxHeader;
+
+// the entries of an index node are sorted by `hash`. the first one of the
+// root has hash zero.
+typedef struct {
+    u16 zero;
+    u16 unused;
+    u32 hash;   // the least hash under `block`.
+    u32 block;  // the leaf or index node, a block index in the directory.
+    u32 unused2;
+} DxEntry;
+
+// FNV-1a over the name.
+static INLINE u32 dir_hash(const char* name) {
+    u32 h = 2166136261u;
+    for (usize i = 0; i < FILE_NAME_MAX_LENGTH && name[i]; i++)
+        h = (h ^ (u8)name[i]) * 16777619u;
+    return h;
+}
+
 typedef struct {
     usize num_blocks;
     usize block_no[LOG_MAX_SIZE];
 } LogHeader;
 
 // mkfs only
-#define FSSIZE 1000  // Size of file system in blocks
\ No newline at end of file
+#define FSSIZE 32768  // Size of file system in blocks
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include <common/list.h>
 #include <kernel/mem.h>
 #include <fs/pipe.h>
+#include <fs/readahead.h>
 #include <kernel/sched.h>
 #include <common/string.h>
 #include <kernel/printk.h>
@@ -18,12 +19,38 @@ extern InodeTree inodes;
 extern BlockCache bcache;
 
 void init_ftable() {
-    init_spinlock(&ftable.lock);
+    init_named_spinlock(&ftable.lock, "ftable");
     memset(ftable.file, 0, NFILE*sizeof(struct file));
 }
 
 void init_oftable(struct oftable *oftable) {
     memset(oftable, 0, sizeof(struct oftable));
+    init_spinlock(&oftable->lock);
+    init_rc(&oftable->ref);
+}
+
+struct oftable* create_oftable() {
+    struct oftable* oftable = kalloc(sizeof(struct oftable));
+    init_oftable(oftable);
+    _increment_rc(&oftable->ref);
+    return oftable;
+}
+
+struct oftable* share_oftable(struct oftable* oftable) {
+    _increment_rc(&oftable->ref);
+    return oftable;
+}
+
+void put_oftable(struct oftable* oftable) {
+    if (!_decrement_rc(&oftable->ref))
+        return;
+    for (int fd = 0; fd < NOFILE; fd++) {
+        if (oftable->ofile[fd]) {
+            fileclose(oftable->ofile[fd]);
+            oftable->ofile[fd] = 0;
+        }
+    }
+    kfree(oftable);
 }
 
 /* Allocate a file structure. */
@@ -33,6 +60,7 @@ struct file* filealloc() {
     for (f = ftable.file; f < ftable.file + NFILE; f++) {
         if (f->ref == 0) {
             f->ref = 1;
+            f->ra_off = f->ra_window = f->ra_next = 0;
             _release_spinlock(&ftable.lock);
             return f;
         }
@@ -103,10 +131,12 @@ isize fileread(struct file* f, char* addr, isize n) {
     else if (f->type == FD_INODE) {
         // printk("FD_INODE\n");
         inodes.lock(f->ip);
+        file_readahead(f, n);
         r = inodes.read(f->ip, (u8*)addr, f->off, n);
         if (r > 0) {
             f->off += r;
         }
+        f->ra_off = f->off;
         inodes.unlock(f->ip);
     }
     else {
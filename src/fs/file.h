@@ -7,6 +7,7 @@
 #include <fs/inode.h>
 #include <sys/stat.h>
 #include <common/list.h>
+#include <common/rc.h>
 #include <fs/file.h>
 
 #define NFILE 65536  // Open files per system
@@ -20,6 +21,10 @@ typedef struct file {
     struct pipe* pipe;
     Inode* ip;
     usize off;
+    // read-ahead state, see `file_readahead`.
+    usize ra_off;     // where the last read ended
+    usize ra_window;  // in blocks, zero if the reads are not sequential
+    usize ra_next;    // blocks before this offset are already read ahead
 } File;
 
 struct ftable {
@@ -28,11 +33,21 @@ struct ftable {
 };
 
 struct oftable {
+    SpinLock lock; // for fd allocation
+    RefCount ref;  // threads of a process share one oftable
     struct file* ofile[NOFILE];
 };
 
 void init_ftable();
 void init_oftable(struct oftable*);
+WARN_RESULT struct oftable* create_oftable();
+struct oftable* share_oftable(struct oftable*);
+
+/*
+ * Decrement ref count of the oftable.
+ * Close all its files and free it when reaches 0.
+ */
+void put_oftable(struct oftable*);
 
 /*
  * Iterate the file table to get a file structure with ref == 0.
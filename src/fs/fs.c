@@ -4,17 +4,23 @@
 #include <fs/fs.h>
 #include <fs/inode.h>
 #include <fs/file.h>
+#include <fs/readahead.h>
 #include <common/defines.h>
 #include <kernel/init.h>
 #include <kernel/printk.h>
+#include <kernel/proc.h>
 
 void init_filesystem() {
     init_block_device();
 
     const SuperBlock* sblock = get_super_block();
     init_bcache(sblock, &block_device);
+    auto flusher = create_proc();
+    set_parent_to_this(flusher);
+    start_proc(flusher, log_flusher, 0);
     init_inodes(sblock, &bcache);
     init_ftable();
+    init_readahead();
 }
 define_rest_init(fs) {
     init_filesystem();
@@ -8,10 +8,15 @@
 #include <kernel/proc.h>
 #include <kernel/sched.h>
 
-// this lock mainly prevents concurrent access to inode list `head`, reference
-// count increment and decrement.
+// this lock mainly prevents concurrent access to the inode hash table and
+// the LRU list, reference count increment and decrement.
 static SpinLock lock;
-static ListNode head;
+static Inode* hash[INODE_HASH_SIZE];  // in-memory inodes chained by inode_no.
+// unreferenced inodes, the most recently released first. they are freed
+// from the tail beyond `INODE_CACHE_UNUSED`, or by `reclaim_inodes`.
+static ListNode lru;
+static usize num_cached, num_unused;
+static usize hits, misses;
 
 static const SuperBlock* sblock;
 static const BlockCache* cache;
@@ -31,10 +36,122 @@ static INLINE u32* get_addrs(Block* block) {
     return ((IndirectBlock*)block->data)->addrs;
 }
 
+// the directory entry cache. an entry maps a name in the directory `parent`
+// to its inode number and index, or to zero if the name is not there.
+typedef struct Dentry {
+    usize parent;  // zero if the slot is free.
+    char name[FILE_NAME_MAX_LENGTH];
+    usize inode_no;
+    usize index;
+    ListNode node;         // on the LRU list.
+    struct Dentry* hnext;  // next entry in the same hash bucket.
+} Dentry;
+
+static struct {
+    SpinLock lock;
+    Dentry slots[DCACHE_SIZE];
+    Dentry* hash[DCACHE_HASH_SIZE];
+    ListNode lru;  // all slots, the most recently used first.
+    usize hits, negative_hits, misses;
+} dcache;
+
+static void init_dcache() {
+    init_named_spinlock(&dcache.lock, "dcache");
+    memset(dcache.hash, 0, sizeof(dcache.hash));
+    init_list_node(&dcache.lru);
+    for (usize i = 0; i < DCACHE_SIZE; i++) {
+        dcache.slots[i].parent = 0;
+        _insert_into_list(&dcache.lru, &dcache.slots[i].node);
+    }
+    dcache.hits = dcache.negative_hits = dcache.misses = 0;
+}
+
+static usize dentry_hash(usize parent, const char* name) {
+    usize h = parent;
+    for (usize i = 0; i < FILE_NAME_MAX_LENGTH && name[i]; i++)
+        h = h * 31 + (u8)name[i];
+    return h % DCACHE_HASH_SIZE;
+}
+
+// the following 2 functions must hold dcache.lock.
+static Dentry* dentry_lookup(usize parent, const char* name) {
+    Dentry* d = dcache.hash[dentry_hash(parent, name)];
+    while (d && (d->parent != parent || strncmp(d->name, name, FILE_NAME_MAX_LENGTH)))
+        d = d->hnext;
+    return d;
+}
+
+static void dentry_drop(Dentry* d) {
+    Dentry** p = &dcache.hash[dentry_hash(d->parent, d->name)];
+    while (*p != d)
+        p = &(*p)->hnext;
+    *p = d->hnext;
+    d->parent = 0;
+    _detach_from_list(&d->node);
+    _insert_into_list(dcache.lru.prev, &d->node);
+}
+
+// look up `name` in the directory `parent`. return false if it is not
+// cached. otherwise `*inode_no` is set, and `*index` too if it is found.
+static bool dcache_lookup(usize parent, const char* name, usize* inode_no, usize* index) {
+    _acquire_spinlock(&dcache.lock);
+    Dentry* d = dentry_lookup(parent, name);
+    if (d) {
+        dcache.hits++;
+        if (d->inode_no == 0)
+            dcache.negative_hits++;
+        else if (index)
+            *index = d->index;
+        *inode_no = d->inode_no;
+        _detach_from_list(&d->node);
+        _insert_into_list(&dcache.lru, &d->node);
+    } else
+        dcache.misses++;
+    _release_spinlock(&dcache.lock);
+    return d != NULL;
+}
+
+// cache that `name` in the directory `parent` is `inode_no` at `index`, or
+// that it is missing if `inode_no` is zero.
+static void dcache_add(usize parent, const char* name, usize inode_no, usize index) {
+    _acquire_spinlock(&dcache.lock);
+    Dentry* d = dentry_lookup(parent, name);
+    if (!d) {
+        // take the least recently used slot.
+        d = container_of(dcache.lru.prev, Dentry, node);
+        if (d->parent)
+            dentry_drop(d);
+        d->parent = parent;
+        strncpy(d->name, name, FILE_NAME_MAX_LENGTH);
+        usize h = dentry_hash(parent, name);
+        d->hnext = dcache.hash[h];
+        dcache.hash[h] = d;
+    }
+    d->inode_no = inode_no;
+    d->index = index;
+    _detach_from_list(&d->node);
+    _insert_into_list(&dcache.lru, &d->node);
+    _release_spinlock(&dcache.lock);
+}
+
+// forget the entries of the directory `parent`.
+static void dcache_drop_dir(usize parent) {
+    _acquire_spinlock(&dcache.lock);
+    for (usize i = 0; i < DCACHE_SIZE; i++) {
+        if (dcache.slots[i].parent == parent)
+            dentry_drop(&dcache.slots[i]);
+    }
+    _release_spinlock(&dcache.lock);
+}
+
 // initialize inode tree.
 void init_inodes(const SuperBlock* _sblock, const BlockCache* _cache) {
-    init_spinlock(&lock);
-    init_list_node(&head);
+    init_named_spinlock(&lock, "inode");
+    memset(hash, 0, sizeof(hash));
+    init_list_node(&lru);
+    num_cached = num_unused = 0;
+    hits = misses = 0;
+    init_dcache();
     sblock = _sblock;
     cache = _cache;
 
@@ -51,6 +168,73 @@ static void init_inode(Inode* inode) {
     init_list_node(&inode->node);
     inode->inode_no = 0;
     inode->valid = false;
+    inode->prealloc_wanted = 0;
+    inode->prealloc_next = inode->prealloc_end = 0;
+}
+
+// the following 3 functions must hold the lock.
+static Inode* hash_lookup(usize inode_no) {
+    Inode* inode = hash[inode_no % INODE_HASH_SIZE];
+    while (inode && inode->inode_no != inode_no)
+        inode = inode->hnext;
+    return inode;
+}
+
+static void hash_insert(Inode* inode) {
+    Inode** head = &hash[inode->inode_no % INODE_HASH_SIZE];
+    inode->hnext = *head;
+    *head = inode;
+    num_cached++;
+}
+
+static void hash_remove(Inode* inode) {
+    Inode** p = &hash[inode->inode_no % INODE_HASH_SIZE];
+    while (*p != inode)
+        p = &(*p)->hnext;
+    *p = inode->hnext;
+    num_cached--;
+}
+
+// free the least recently released inodes, until at most `keep` are left
+// unreferenced or `num_inodes` are freed. must hold the lock.
+static usize shrink_unused(usize keep, usize num_inodes) {
+    usize n = 0;
+    while (num_unused > keep && n < num_inodes) {
+        Inode* inode = container_of(lru.prev, Inode, node);
+        _detach_from_list(&inode->node);
+        num_unused--;
+        hash_remove(inode);
+        kfree(inode);
+        n++;
+    }
+    return n;
+}
+
+// see `inode.h`.
+void get_inode_cache_stat(InodeCacheStat* stat) {
+    _acquire_spinlock(&lock);
+    stat->hits = hits;
+    stat->misses = misses;
+    stat->num_cached = num_cached;
+    stat->num_unused = num_unused;
+    _release_spinlock(&lock);
+}
+
+// see `inode.h`.
+usize reclaim_inodes(usize num_inodes) {
+    _acquire_spinlock(&lock);
+    usize n = shrink_unused(0, num_inodes);
+    _release_spinlock(&lock);
+    return n;
+}
+
+// see `inode.h`.
+void get_dcache_stat(DcacheStat* stat) {
+    _acquire_spinlock(&dcache.lock);
+    stat->hits = dcache.hits;
+    stat->negative_hits = dcache.negative_hits;
+    stat->misses = dcache.misses;
+    _release_spinlock(&dcache.lock);
 }
 
 // see `inode.h`.
@@ -110,17 +294,20 @@ static Inode* inode_get(usize inode_no) {
     ASSERT(inode_no < sblock->num_inodes);
 
     _acquire_spinlock(&lock);
-    
-    _for_in_list(node, &head) {
-        if (node == &head)  continue;
-
-        Inode* inode = container_of(node, Inode, node);
-        if (inode->inode_no == inode_no){
-            _increment_rc(&inode->rc);
-            _release_spinlock(&lock);
-            return inode;
+
+    Inode* inode = hash_lookup(inode_no);
+    if (inode) {
+        hits++;
+        // an unreferenced inode is revived with its entry still valid.
+        if (inode->rc.count == 0) {
+            _detach_from_list(&inode->node);
+            num_unused--;
         }
+        _increment_rc(&inode->rc);
+        _release_spinlock(&lock);
+        return inode;
     }
+    misses++;
 
     Block* block = cache->acquire(sblock->inode_start + inode_no/IPB);
     InodeEntry* d_inode = (InodeEntry*)block->data + inode_no%IPB;
@@ -132,7 +319,7 @@ static Inode* inode_get(usize inode_no) {
     inode_new->inode_no = inode_no;
     memcpy(&inode_new->entry, d_inode, sizeof(InodeEntry));
     inode_new->valid = true;
-    _insert_into_list(&head, &inode_new->node);
+    hash_insert(inode_new);
     
     cache->release(block);
 
@@ -140,9 +327,28 @@ static Inode* inode_get(usize inode_no) {
     return inode_new;
 }
 
+// free the blocks mapped by the indirect block `block_no` and the block
+// itself. with `depth` 2, its entries are indirect blocks as well.
+static void free_indirect(OpContext* ctx, usize block_no, int depth) {
+    Block* indirect_block = cache->acquire(block_no);
+    IndirectBlock* indirect = (IndirectBlock*)indirect_block->data;
+    for (usize i = 0; i < INODE_NUM_INDIRECT; i++) {
+        if (indirect->addrs[i] == 0)
+            continue;
+        if (depth > 1)
+            free_indirect(ctx, indirect->addrs[i], depth - 1);
+        else
+            cache->free(ctx, indirect->addrs[i]);
+    }
+    cache->release(indirect_block);
+    cache->free(ctx, block_no);
+}
+
 // see `inode.h`.
 static void inode_clear(OpContext* ctx, Inode* inode) {
     // TODO
+    if (inode->entry.type == INODE_DIRECTORY)
+        dcache_drop_dir(inode->inode_no);
     for (usize i = 0; i < INODE_NUM_DIRECT; i++) {
         if (inode->entry.addrs[i] != 0) {
             cache->free(ctx, inode->entry.addrs[i]);
@@ -150,18 +356,13 @@ static void inode_clear(OpContext* ctx, Inode* inode) {
         }
     }
     if (inode->entry.indirect) {
-        Block* indirect_block = cache->acquire(inode->entry.indirect);
-        IndirectBlock* indirect = (IndirectBlock*)indirect_block->data;
-        for (usize i = 0; i < INODE_NUM_INDIRECT; i++) {
-            if (indirect->addrs[i] != 0) {
-                cache->free(ctx, indirect->addrs[i]);
-            }
-        }
-        cache->release(indirect_block); 
-
-        cache->free(ctx, inode->entry.indirect);
+        free_indirect(ctx, inode->entry.indirect, 1);
         inode->entry.indirect = 0;
     }
+    if (inode->entry.double_indirect) {
+        free_indirect(ctx, inode->entry.double_indirect, 2);
+        inode->entry.double_indirect = 0;
+    }
     inode->entry.num_bytes = 0;
     inode_sync(ctx, inode, true);
 }
@@ -188,6 +389,8 @@ static void inode_put(OpContext* ctx, Inode* inode) {
     
     if ((inode->entry.num_links == 0)) {
         unalertable_wait_sem(&inode->lock);
+        // nobody can find it while its blocks are freed.
+        hash_remove(inode);
         _release_spinlock(&lock);
 
         inode_clear(ctx, inode);
@@ -201,13 +404,61 @@ static void inode_put(OpContext* ctx, Inode* inode) {
         cache->release(block);
 
         post_sem(&inode->lock);
-        _acquire_spinlock(&lock);
+        kfree(inode);
+        return;
     }
-    _detach_from_list(&inode->node);
-    kfree(inode);
+
+    // keep it for the next `get`.
+    _insert_into_list(&lru, &inode->node);
+    num_unused++;
+    shrink_unused(INODE_CACHE_UNUSED, num_unused);
     _release_spinlock(&lock);
 }
 
+// the allocation goal for the block that comes after `block_no` in a file.
+static INLINE usize next_goal(usize block_no) {
+    return block_no ? block_no + 1 : 0;
+}
+
+// allocate a data block of `inode` near `goal`. it is taken from the run
+// reserved by `inode_write` if there is one, and it is not zeroed then.
+static usize alloc_data(OpContext* ctx, Inode* inode, usize goal) {
+    if (inode->prealloc_next == inode->prealloc_end && inode->prealloc_wanted > 0) {
+        usize count = inode->prealloc_wanted;
+        inode->prealloc_next = cache->alloc_run(ctx, goal, &count);
+        inode->prealloc_end = inode->prealloc_next + count;
+        inode->prealloc_wanted -= count;
+    }
+    if (inode->prealloc_next < inode->prealloc_end)
+        return inode->prealloc_next++;
+    return cache->alloc_near(ctx, goal);
+}
+
+// return the entry `index` of the indirect block `block_no`, allocating a
+// block for it if it is empty. a data block of `inode` is allocated by
+// `alloc_data`, and an indirect block if `inode` is NULL.
+static usize map_indirect(OpContext* ctx,
+                          Inode* inode,
+                          usize block_no,
+                          usize index,
+                          bool* modified) {
+    Block* indirect_block = cache->acquire(block_no);
+    IndirectBlock* indirect = (IndirectBlock*)indirect_block->data;
+    // only a new mapping dirties the indirect block, reads leave it alone.
+    bool changed = indirect->addrs[index] == 0;
+    if (changed) {
+        usize goal = index > 0 ? next_goal(indirect->addrs[index - 1]) : block_no + 1;
+        indirect->addrs[index] = inode ? alloc_data(ctx, inode, goal)
+                                       : cache->alloc_near(ctx, goal);
+        if (modified)   *modified = true;
+    }
+    usize bno = indirect->addrs[index];
+    if (changed)
+        cache->sync(ctx, indirect_block);
+    cache->release(indirect_block);
+    return bno;
+}
+
 // this function is private to inode layer, because it can allocate block
 // at arbitrary offset, which breaks the usual file abstraction.
 //
@@ -226,30 +477,56 @@ static usize inode_map(OpContext* ctx,
     usize off_no = offset / BLOCK_SIZE;
     if (off_no < INODE_NUM_DIRECT) {
         if (inode->entry.addrs[off_no] == 0) {
-            inode->entry.addrs[off_no] = cache->alloc(ctx);
+            usize goal = off_no > 0 ? next_goal(inode->entry.addrs[off_no - 1]) : 0;
+            inode->entry.addrs[off_no] = alloc_data(ctx, inode, goal);
             if (modified)   *modified = true;
         }
         return inode->entry.addrs[off_no];
     }
     off_no -= INODE_NUM_DIRECT;
-    ASSERT(off_no < INODE_NUM_INDIRECT);
-
-    usize indirect_no = inode->entry.indirect;
-    if(indirect_no == 0) {
-        inode->entry.indirect = indirect_no = cache->alloc(ctx);
-    }
-    Block* indirect_block = cache->acquire(indirect_no);
-    IndirectBlock* indirect = (IndirectBlock*)indirect_block->data;
-    if (indirect->addrs[off_no] == 0) {
-        indirect->addrs[off_no] = cache->alloc(ctx);
-        if (modified)   *modified = true;
+    if (off_no < INODE_NUM_INDIRECT) {
+        if (inode->entry.indirect == 0)
+            inode->entry.indirect = cache->alloc_near(
+                ctx, next_goal(inode->entry.addrs[INODE_NUM_DIRECT - 1]));
+        return map_indirect(ctx, inode, inode->entry.indirect, off_no, modified);
     }
-    usize bno = indirect->addrs[off_no];
-    cache->sync(ctx, indirect_block);
+    off_no -= INODE_NUM_INDIRECT;
+    ASSERT(off_no < INODE_NUM_DOUBLE);
+
+    if (inode->entry.double_indirect == 0)
+        inode->entry.double_indirect =
+            cache->alloc_near(ctx, next_goal(inode->entry.indirect));
+    usize indirect_no = map_indirect(ctx, NULL, inode->entry.double_indirect,
+                                     off_no / INODE_NUM_INDIRECT, modified);
+    return map_indirect(ctx, inode, indirect_no, off_no % INODE_NUM_INDIRECT, modified);
+}
+
+// the entry `index` of the indirect block `block_no`, or zero.
+static usize lookup_indirect(usize block_no, usize index) {
+    if (block_no == 0)
+        return 0;
+    Block* indirect_block = cache->acquire(block_no);
+    usize bno = ((IndirectBlock*)indirect_block->data)->addrs[index];
     cache->release(indirect_block);
     return bno;
 }
 
+// see `inode.h`.
+static usize inode_bmap(Inode* inode, usize offset) {
+    usize off_no = offset / BLOCK_SIZE;
+    if (off_no < INODE_NUM_DIRECT)
+        return inode->entry.addrs[off_no];
+    off_no -= INODE_NUM_DIRECT;
+    if (off_no < INODE_NUM_INDIRECT)
+        return lookup_indirect(inode->entry.indirect, off_no);
+    off_no -= INODE_NUM_INDIRECT;
+    if (off_no >= INODE_NUM_DOUBLE)
+        return 0;
+    usize indirect_no = lookup_indirect(inode->entry.double_indirect,
+                                        off_no / INODE_NUM_INDIRECT);
+    return lookup_indirect(indirect_no, off_no % INODE_NUM_INDIRECT);
+}
+
 // see `inode.h`.
 static usize inode_read(Inode* inode, u8* dest, usize offset, usize count) {
     InodeEntry* entry = &inode->entry;
@@ -301,21 +578,39 @@ static usize inode_write(OpContext* ctx,
     ASSERT(offset <= end);
 
     // TODO
+    // the blocks from the one after the end of the file are new, as files
+    // have no holes. they are reserved together, and are not read from disk
+    // or zeroed before they are written.
+    usize first_new = (entry->num_bytes + BSIZE - 1) / BSIZE;
+    usize end_block = (end + BSIZE - 1) / BSIZE;
+    if (end_block > first_new)
+        inode->prealloc_wanted = end_block - first_new;
+
     usize cnt;
     usize inc;
     for (cnt = 0; cnt < count; cnt += inc, offset += inc, src += inc) {
         bool modified;
         usize bno = inode_map(ctx, inode, offset, &modified);
 
-        Block* block = cache->acquire(bno);
         usize inc1 = BSIZE - offset % BSIZE;
         usize inc2 = count - cnt;
         inc = (inc1 < inc2) ? inc1 : inc2;
+        Block* block;
+        if (offset / BSIZE >= first_new) {
+            block = cache->acquire_new(bno);
+            if (inc < BSIZE)
+                memset(block->data, 0, BSIZE);
+        } else
+            block = cache->acquire(bno);
         memcpy(block->data + offset%BSIZE, src, inc);
         cache->sync(ctx, block);
         cache->release(block);
     }
 
+    // every reserved block is mapped by now.
+    ASSERT(inode->prealloc_next == inode->prealloc_end);
+    inode->prealloc_wanted = 0;
+
     if (end > inode->entry.num_bytes)
         inode->entry.num_bytes = end;
     inode_sync(ctx, inode, true);
@@ -323,30 +618,394 @@ static usize inode_write(OpContext* ctx,
     return cnt;
 }
 
+/* Indexed directories, see `defines.h`. */
+
+// the block number of the block `k` of the directory `inode`.
+static INLINE usize dir_block(Inode* inode, usize k) {
+    return inode_bmap(inode, k * BSIZE);
+}
+
+// the index node in the directory block `k`, which is the root if `k` is 0.
+static INLINE DxHeader* dx_node(Block* block, usize k) {
+    return (DxHeader*)(block->data + (k == 0 ? DX_ROOT_OFFSET : 0));
+}
+
+static INLINE DxEntry* dx_entries(DxHeader* node) {
+    return (DxEntry*)(node + 1);
+}
+
+// is the directory `inode` indexed? a linear directory never has the magic
+// in block 0, as a free entry there is all zeros.
+static bool dx_indexed(Inode* inode) {
+    if (inode->entry.num_bytes <= DIR_LINEAR_MAX_BLOCKS * BSIZE)
+        return false;
+    Block* block = cache->acquire(dir_block(inode, 0));
+    DxHeader* root = dx_node(block, 0);
+    bool indexed = root->zero == 0 && root->magic == DX_MAGIC;
+    cache->release(block);
+    return indexed;
+}
+
+// append a zeroed block to the directory `inode`, and return its index.
+static usize dir_grow(OpContext* ctx, Inode* inode) {
+    usize k = inode->entry.num_bytes / BSIZE;
+    inode_map(ctx, inode, k * BSIZE, NULL);
+    inode->entry.num_bytes += BSIZE;
+    inode_sync(ctx, inode, true);
+    return k;
+}
+
+// an index node on the way from the root to a leaf.
+typedef struct {
+    usize block;  // the index of the node in the directory.
+    usize pos;    // the entry taken.
+} DxFrame;
+
+// walk from the root to the leaf of the hash `h`, and return the index of
+// the leaf. the index nodes on the way are recorded in `path`, and their
+// number in `*depth`.
+static usize dx_walk(Inode* inode, u32 h, DxFrame* path, usize* depth) {
+    usize k = 0, n = 0, levels = 0;
+    do {
+        Block* block = cache->acquire(dir_block(inode, k));
+        DxHeader* node = dx_node(block, k);
+        DxEntry* e = dx_entries(node);
+        if (k == 0)
+            levels = node->levels;
+        // the last entry whose hash is not above `h`.
+        usize lo = 0, hi = node->count;
+        while (hi - lo > 1) {
+            usize mid = (lo + hi) / 2;
+            if (e[mid].hash <= h)
+                lo = mid;
+            else
+                hi = mid;
+        }
+        path[n].block = k;
+        path[n].pos = lo;
+        n++;
+        k = e[lo].block;
+        cache->release(block);
+    } while (n <= levels);
+    *depth = n;
+    return k;
+}
+
+// find `name` among the `n` entries `de`. return its position, or `n`.
+static usize find_name(DirEntry* de, usize n, const char* name) {
+    for (usize i = 0; i < n; i++) {
+        if (de[i].inode_no != 0 && strncmp(de[i].name, name, FILE_NAME_MAX_LENGTH) == 0)
+            return i;
+    }
+    return n;
+}
+
+// look up `name` in the indexed directory `inode`. return its inode number
+// and set `*offset`, or return zero.
+static usize dx_lookup(Inode* inode, const char* name, usize* offset) {
+    // the first two entries of block 0 are not indexed.
+    Block* block = cache->acquire(dir_block(inode, 0));
+    DirEntry* de = (DirEntry*)block->data;
+    usize i = find_name(de, 2, name);
+    usize ino = i < 2 ? de[i].inode_no : 0;
+    cache->release(block);
+    if (ino) {
+        *offset = i * sizeof(DirEntry);
+        return ino;
+    }
+
+    DxFrame path[DX_MAX_LEVELS + 1];
+    usize depth;
+    usize k = dx_walk(inode, dir_hash(name), path, &depth);
+    block = cache->acquire(dir_block(inode, k));
+    de = (DirEntry*)block->data;
+    i = find_name(de, DIR_PER_BLOCK, name);
+    if (i < DIR_PER_BLOCK) {
+        ino = de[i].inode_no;
+        *offset = k * BSIZE + i * sizeof(DirEntry);
+    }
+    cache->release(block);
+    return ino;
+}
+
+// sort `n` entries by the hash of their names.
+static void sort_by_hash(DirEntry* de, usize n) {
+    for (usize i = 1; i < n; i++) {
+        DirEntry x = de[i];
+        u32 h = dir_hash(x.name);
+        usize j = i;
+        for (; j > 0 && dir_hash(de[j - 1].name) > h; j--)
+            de[j] = de[j - 1];
+        de[j] = x;
+    }
+}
+
+// a position near the middle of `n` entries sorted by hash, where the hash
+// changes. the entries from it on go to another leaf. return `n` if all the
+// names have the same hash.
+static usize split_point(DirEntry* de, usize n) {
+    for (usize d = 0; d < n / 2; d++) {
+        usize m = n / 2 - d;
+        if (dir_hash(de[m - 1].name) != dir_hash(de[m].name))
+            return m;
+        m = n / 2 + d + 1;
+        if (m < n && dir_hash(de[m - 1].name) != dir_hash(de[m].name))
+            return m;
+    }
+    return n;
+}
+
+// can an entry be added under `path[level]`? full nodes on the way up are
+// split, but the root can only grow while it has levels to spare.
+static bool dx_has_room(Inode* inode, DxFrame* path, usize level) {
+    for (;; level--) {
+        usize k = path[level].block;
+        Block* block = cache->acquire(dir_block(inode, k));
+        DxHeader* node = dx_node(block, k);
+        usize capacity = k == 0 ? DX_ROOT_ENTRIES : DX_NODE_ENTRIES;
+        bool room = node->count < capacity || (k == 0 && node->levels < DX_MAX_LEVELS);
+        cache->release(block);
+        if (room || k == 0)
+            return room;
+    }
+}
+
+// insert an entry for the node or leaf `child`, whose least hash is `h`,
+// after the entry taken at `path[level]`. a full node is split, and a full
+// root pushes its entries down to a new level.
+static void dx_insert_entry(OpContext* ctx,
+                            Inode* inode,
+                            DxFrame* path,
+                            usize level,
+                            u32 h,
+                            usize child) {
+    usize k = path[level].block;
+    usize pos = path[level].pos + 1;
+    Block* block = cache->acquire(dir_block(inode, k));
+    DxHeader* node = dx_node(block, k);
+    DxEntry* e = dx_entries(node);
+    usize capacity = k == 0 ? DX_ROOT_ENTRIES : DX_NODE_ENTRIES;
+    DxEntry x = {.hash = h, .block = (u32)child};
+
+    if (node->count < capacity) {
+        memmove(e + pos + 1, e + pos, (node->count - pos) * sizeof(DxEntry));
+        e[pos] = x;
+        node->count++;
+        cache->sync(ctx, block);
+        cache->release(block);
+        return;
+    }
+
+    if (k == 0) {
+        // a node has room for every entry of the root and one more. see
+        // `dx_has_room` for the levels.
+        ASSERT(node->levels < DX_MAX_LEVELS);
+        cache->release(block);
+        usize ck = dir_grow(ctx, inode);
+        block = cache->acquire(dir_block(inode, 0));
+        node = dx_node(block, 0);
+        e = dx_entries(node);
+        Block* child_block = cache->acquire(dir_block(inode, ck));
+        DxHeader* c = dx_node(child_block, ck);
+        DxEntry* ce = dx_entries(c);
+        memcpy(ce, e, pos * sizeof(DxEntry));
+        ce[pos] = x;
+        memcpy(ce + pos + 1, e + pos, (node->count - pos) * sizeof(DxEntry));
+        c->count = node->count + 1;
+        cache->sync(ctx, child_block);
+        cache->release(child_block);
+
+        node->levels++;
+        node->count = 1;
+        e[0].hash = 0;
+        e[0].block = (u32)ck;
+        memset(e + 1, 0, (capacity - 1) * sizeof(DxEntry));
+        cache->sync(ctx, block);
+        cache->release(block);
+        return;
+    }
+
+    // split the node, and give the upper half to a new one.
+    cache->release(block);
+    usize nk = dir_grow(ctx, inode);
+    DxEntry* all = kalloc((capacity + 1) * sizeof(DxEntry));
+    block = cache->acquire(dir_block(inode, k));
+    node = dx_node(block, k);
+    e = dx_entries(node);
+    memcpy(all, e, pos * sizeof(DxEntry));
+    all[pos] = x;
+    memcpy(all + pos + 1, e + pos, (node->count - pos) * sizeof(DxEntry));
+    usize n = capacity + 1, m = n / 2;
+    memcpy(e, all, m * sizeof(DxEntry));
+    memset(e + m, 0, (capacity - m) * sizeof(DxEntry));
+    node->count = (u16)m;
+    cache->sync(ctx, block);
+    cache->release(block);
+
+    Block* new_block = cache->acquire(dir_block(inode, nk));
+    DxHeader* new_node = dx_node(new_block, nk);
+    memcpy(dx_entries(new_node), all + m, (n - m) * sizeof(DxEntry));
+    new_node->count = (u16)(n - m);
+    cache->sync(ctx, new_block);
+    cache->release(new_block);
+    u32 boundary = all[m].hash;
+    kfree(all);
+
+    dx_insert_entry(ctx, inode, path, level - 1, boundary, nk);
+}
+
+// add `name` to the indexed directory `inode`, which does not have it yet.
+// return the offset of the new entry, or -1 if the directory is full.
+static usize dx_insert(OpContext* ctx, Inode* inode, const char* name, usize inode_no) {
+    DxFrame path[DX_MAX_LEVELS + 1];
+    usize depth;
+    usize k = dx_walk(inode, dir_hash(name), path, &depth);
+
+    Block* block = cache->acquire(dir_block(inode, k));
+    DirEntry* de = (DirEntry*)block->data;
+    for (usize i = 0; i < DIR_PER_BLOCK; i++) {
+        if (de[i].inode_no == 0) {
+            de[i].inode_no = (u16)inode_no;
+            strncpy(de[i].name, name, FILE_NAME_MAX_LENGTH);
+            cache->sync(ctx, block);
+            cache->release(block);
+            return k * BSIZE + i * sizeof(DirEntry);
+        }
+    }
+
+    // the leaf is full: split it, and give the upper half to a new leaf.
+    usize n = DIR_PER_BLOCK + 1;
+    DirEntry* all = kalloc(n * sizeof(DirEntry));
+    memcpy(all, de, BSIZE);
+    cache->release(block);
+    all[n - 1].inode_no = (u16)inode_no;
+    strncpy(all[n - 1].name, name, FILE_NAME_MAX_LENGTH);
+    sort_by_hash(all, n);
+    usize m = split_point(all, n);
+    // the names of the leaf cannot be split, or the index cannot take
+    // another leaf. nothing is changed yet.
+    if (m == n || !dx_has_room(inode, path, depth - 1)) {
+        kfree(all);
+        return -1;
+    }
+
+    usize nk = dir_grow(ctx, inode);
+    block = cache->acquire(dir_block(inode, k));
+    de = (DirEntry*)block->data;
+    memcpy(de, all, m * sizeof(DirEntry));
+    memset(de + m, 0, (DIR_PER_BLOCK - m) * sizeof(DirEntry));
+    cache->sync(ctx, block);
+    cache->release(block);
+
+    Block* new_block = cache->acquire(dir_block(inode, nk));
+    memcpy(new_block->data, all + m, (n - m) * sizeof(DirEntry));
+    cache->sync(ctx, new_block);
+    cache->release(new_block);
+
+    usize i = find_name(all, n, name);
+    usize offset = i < m ? k * BSIZE + i * sizeof(DirEntry)
+                         : nk * BSIZE + (i - m) * sizeof(DirEntry);
+    u32 boundary = dir_hash(all[m].name);
+    kfree(all);
+
+    dx_insert_entry(ctx, inode, path, depth - 1, boundary, nk);
+    // the entries moved.
+    dcache_drop_dir(inode->inode_no);
+    return offset;
+}
+
+// index the linear directory `inode`, whose `DIR_LINEAR_MAX_BLOCKS` blocks
+// are full. the entries after the first two are split into two leaves.
+// return false, with nothing changed, if they cannot be.
+static bool dx_convert(OpContext* ctx, Inode* inode) {
+    usize n = DIR_LINEAR_MAX_BLOCKS * DIR_PER_BLOCK - 2;
+    DirEntry* all = kalloc(n * sizeof(DirEntry));
+    Block* block = cache->acquire(dir_block(inode, 0));
+    memcpy(all, block->data + DX_ROOT_OFFSET, BSIZE - DX_ROOT_OFFSET);
+    cache->release(block);
+    for (usize k = 1; k < DIR_LINEAR_MAX_BLOCKS; k++) {
+        block = cache->acquire(dir_block(inode, k));
+        memcpy((u8*)all + k * BSIZE - DX_ROOT_OFFSET, block->data, BSIZE);
+        cache->release(block);
+    }
+    sort_by_hash(all, n);
+    usize m = split_point(all, n);
+    if (m > DIR_PER_BLOCK || n - m > DIR_PER_BLOCK) {
+        kfree(all);
+        return false;
+    }
+
+    // the lower half goes to block 1, which it fits in, and the upper half
+    // to a new block.
+    usize nk = dir_grow(ctx, inode);
+    block = cache->acquire(dir_block(inode, nk));
+    memcpy(block->data, all + m, (n - m) * sizeof(DirEntry));
+    cache->sync(ctx, block);
+    cache->release(block);
+    for (usize k = 1; k < DIR_LINEAR_MAX_BLOCKS; k++) {
+        block = cache->acquire(dir_block(inode, k));
+        memset(block->data, 0, BSIZE);
+        if (k == 1)
+            memcpy(block->data, all, m * sizeof(DirEntry));
+        cache->sync(ctx, block);
+        cache->release(block);
+    }
+
+    block = cache->acquire(dir_block(inode, 0));
+    memset(block->data + DX_ROOT_OFFSET, 0, BSIZE - DX_ROOT_OFFSET);
+    DxHeader* root = dx_node(block, 0);
+    DxEntry* e = dx_entries(root);
+    root->magic = DX_MAGIC;
+    root->levels = 0;
+    root->count = 2;
+    e[0].hash = 0;
+    e[0].block = 1;
+    e[1].hash = dir_hash(all[m].name);
+    e[1].block = (u32)nk;
+    cache->sync(ctx, block);
+    cache->release(block);
+    kfree(all);
+
+    dcache_drop_dir(inode->inode_no);
+    return true;
+}
+
 // see `inode.h`.
 static usize inode_lookup(Inode* inode, const char* name, usize* index) {
     InodeEntry* entry = &inode->entry;
     ASSERT(entry->type == INODE_DIRECTORY);
 
     // TODO
-    DirEntry d_entry;
-    for(usize offset = 0; offset < entry->num_bytes; offset += sizeof(DirEntry)) {
-        usize cnt = inode_read(inode, (u8*)&d_entry, offset, sizeof(DirEntry));
-        ASSERT(cnt == sizeof(DirEntry));
-
-        if (d_entry.inode_no == 0) {
-            continue;
-        }
-        // printk("**%s**%s**%d\n", d_entry.name, name, memcmp(name, d_entry.name, FILE_NAME_MAX_LENGTH));
-        if (strncmp(name, d_entry.name, FILE_NAME_MAX_LENGTH) == 0) {
-            if (index) {
-                *index = offset; 
+    usize ino;
+    if (dcache_lookup(inode->inode_no, name, &ino, index))
+        return ino;
+
+    usize offset = 0;
+    if (dx_indexed(inode)) {
+        ino = dx_lookup(inode, name, &offset);
+    } else {
+        DirEntry d_entry;
+        ino = 0;
+        for(offset = 0; offset < entry->num_bytes; offset += sizeof(DirEntry)) {
+            usize cnt = inode_read(inode, (u8*)&d_entry, offset, sizeof(DirEntry));
+            ASSERT(cnt == sizeof(DirEntry));
+
+            if (d_entry.inode_no == 0) {
+                continue;
+            }
+            if (strncmp(name, d_entry.name, FILE_NAME_MAX_LENGTH) == 0) {
+                ino = d_entry.inode_no;
+                break;
             }
-            return d_entry.inode_no;
         }
     }
 
-    return 0;
+    if (ino == 0)
+        offset = 0;
+    else if (index)
+        *index = offset;
+    dcache_add(inode->inode_no, name, ino, offset);
+    return ino;
 }
 
 // see `inode.h`.
@@ -362,8 +1021,15 @@ static usize inode_insert(OpContext* ctx,
         return -1;
     }
 
-    DirEntry d_entry;
     usize offset;
+    if (dx_indexed(inode)) {
+        offset = dx_insert(ctx, inode, name, inode_no);
+        if (offset != (usize)-1)
+            dcache_add(inode->inode_no, name, inode_no, offset);
+        return offset;
+    }
+
+    DirEntry d_entry;
     for(offset = 0; offset < entry->num_bytes; offset += sizeof(DirEntry)) {
         usize cnt = inode_read(inode, (u8*)&d_entry, offset, sizeof(DirEntry));
         ASSERT(cnt == sizeof(DirEntry));
@@ -372,11 +1038,21 @@ static usize inode_insert(OpContext* ctx,
             break;
         }
     }
+    // a full linear directory is indexed rather than grown. a larger one,
+    // from an older mkfs or with names that cannot be split, stays linear.
+    if (offset == entry->num_bytes && offset == DIR_LINEAR_MAX_BLOCKS * BSIZE &&
+        dx_convert(ctx, inode)) {
+        offset = dx_insert(ctx, inode, name, inode_no);
+        if (offset != (usize)-1)
+            dcache_add(inode->inode_no, name, inode_no, offset);
+        return offset;
+    }
     // printk("--%d--%s\n", offset, name);
     d_entry.inode_no = inode_no;
     strncpy(d_entry.name, name, FILE_NAME_MAX_LENGTH);
     usize cnt = inode_write(ctx, inode, (u8*)&d_entry, offset, sizeof(DirEntry));
     ASSERT(cnt == sizeof(DirEntry));
+    dcache_add(inode->inode_no, name, inode_no, offset);
 
     return offset;
 }
@@ -391,6 +1067,7 @@ static void inode_remove(OpContext* ctx, Inode* inode, usize index) {
     ASSERT(cnt == sizeof(DirEntry));
 
     if (d_entry.inode_no != 0) {
+        dcache_add(inode->inode_no, d_entry.name, 0, 0);
         d_entry.inode_no = 0;
         memset(d_entry.name, 0, FILE_NAME_MAX_LENGTH);
         usize cnt = inode_write(ctx, inode, (u8*)&d_entry, index, sizeof(DirEntry));
@@ -408,6 +1085,7 @@ InodeTree inodes = {
     .share = inode_share,
     .put = inode_put,
     .read = inode_read,
+    .bmap = inode_bmap,
     .write = inode_write,
     .lookup = inode_lookup,
     .insert = inode_insert,
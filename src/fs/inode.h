@@ -13,20 +13,40 @@
 // #define BSIZE         BLOCK_SIZE
 #define IPB           (BSIZE / sizeof(InodeEntry))
 
+// in-memory inodes are found through a hash table of this many buckets.
+#define INODE_HASH_SIZE 256
+
+// at most this many unreferenced inodes are kept in memory, so that they can
+// be used again without reading the inode block.
+#define INODE_CACHE_UNUSED 128
+
+// directory entries looked up recently, including names that were not
+// found, are cached in this many slots, see `lookup`.
+#define DCACHE_SIZE 256
+#define DCACHE_HASH_SIZE 64
+
 struct InodeTree;
 
-typedef struct {
+typedef struct Inode {
     // lock protects:
     // 1. metadata of inode
     // 2. file content managed by this inode
     SleepLock lock;
 
     RefCount rc;
-    ListNode node;
+    ListNode node;        // on the LRU list of unreferenced inodes.
+    struct Inode* hnext;  // next inode in the same hash bucket.
     usize inode_no;
 
     bool valid;        // is `entry` loaded?
     InodeEntry entry;  // real inode data on the disk.
+
+    // an extending `write` reserves a run of blocks for the data blocks it
+    // appends. `prealloc_wanted` more blocks can be reserved, and the
+    // blocks from `prealloc_next` to `prealloc_end` are reserved but not
+    // mapped yet. they never outlive the atomic operation of the `write`.
+    usize prealloc_wanted;
+    usize prealloc_next, prealloc_end;
 } Inode;
 
 typedef struct InodeTree {
@@ -82,6 +102,11 @@ typedef struct InodeTree {
     // NOTE: caller must hold the lock of `inode`.
     usize (*read)(Inode* inode, u8* dest, usize offset, usize count);
 
+    // return the block number where `offset` of `inode` lives, or zero if
+    // the block is not allocated. unlike `write`, it never allocates.
+    // NOTE: caller must hold the lock of `inode`.
+    usize (*bmap)(Inode* inode, usize offset);
+
     // write exactly `count` bytes from `src` to `inode`, beginning at `offset`.
     // return the size you write
     // NOTE: caller must hold the lock of `inode`.
@@ -97,6 +122,8 @@ typedef struct InodeTree {
     // if directory entry with `name` is found, the corresponding non-zero inode
     // number is returned, and the index of directory entry is copied to
     // `*index`. Otherwise it returns zero.
+    // the answer is cached, so the entries of a directory must be changed by
+    // `insert`, `remove` and `clear` only.
     //
     // NOTE: caller must hold the lock of `inode`.
     usize (*lookup)(Inode* inode, const char* name, usize* index);
@@ -110,6 +137,7 @@ typedef struct InodeTree {
     // the index of new directory entry is returned.
     // `insert` does not ensure all directory entries have unique names,
     // if have same names,return -1
+    // it returns -1 too if the directory is full, see `DX_MAX_LEVELS`.
     //
     // NOTE: caller must hold the lock of `inode`.
     usize (*insert)(OpContext* ctx,
@@ -129,6 +157,26 @@ typedef struct InodeTree {
 extern InodeTree inodes;
 
 void init_inodes(const SuperBlock* sblock, const BlockCache* cache);
+
+typedef struct {
+    usize hits;      // `get` found the inode in memory.
+    usize misses;    // `get` read the inode from its block.
+    usize num_cached;
+    usize num_unused;  // cached inodes with no reference.
+} InodeCacheStat;
+
+void get_inode_cache_stat(InodeCacheStat* stat);
+
+typedef struct {
+    usize hits;           // `lookup` answered from the directory entry cache.
+    usize negative_hits;  // hits that found the name missing.
+    usize misses;         // `lookup` read the directory.
+} DcacheStat;
+
+void get_dcache_stat(DcacheStat* stat);
+// free up to `num_inodes` unreferenced inodes under memory pressure.
+// return the number of inodes freed.
+usize reclaim_inodes(usize num_inodes);
 Inode* namei(const char* path, OpContext* ctx);
 Inode* nameiparent(const char* path, char* name, OpContext* ctx);
 void stati(Inode* ip, struct stat* st);
@@ -0,0 +1,130 @@
+#include <fs/iosched.h>
+
+void init_iosched(IOScheduler* s,
+                  IOSchedPolicy policy,
+                  void (*dispatch)(IOScheduler*, IORequest**, usize)) {
+    init_named_spinlock(&s->lock, "iosched");
+    s->policy = policy;
+    init_list_node(&s->reads);
+    init_list_node(&s->writes);
+    s->head = 0;
+    s->read_batches = 0;
+    s->busy = false;
+    s->batch_size = 0;
+    s->dispatch = dispatch;
+    s->requests = s->dispatches = 0;
+}
+
+static INLINE IORequest* request_of(ListNode* node) {
+    return container_of(node, IORequest, node);
+}
+
+// must hold the lock.
+static void queue_request(IOScheduler* s, IORequest* req) {
+    ListNode* list = req->write ? &s->writes : &s->reads;
+    ListNode* prev = list->prev;
+    if (s->policy == IOSCHED_ELEVATOR) {
+        // new requests are mostly behind the pending ones, so search from
+        // the tail.
+        while (prev != list && request_of(prev)->block_no > req->block_no)
+            prev = prev->prev;
+    }
+    _insert_into_list(prev, &req->node);
+    s->requests++;
+}
+
+// take the next batch from `list` into `s->batch`. must hold the lock.
+static void take_batch(IOScheduler* s, ListNode* list) {
+    ListNode* node = list->next;
+    if (s->policy == IOSCHED_ELEVATOR) {
+        // sweep up from the head, and start over from the lowest block at
+        // the end.
+        while (node != list && request_of(node)->block_no < s->head)
+            node = node->next;
+        if (node == list)
+            node = list->next;
+    }
+
+    usize n = 0, blocks = 0;
+    while (node != list && n < IOSCHED_MAX_MERGE) {
+        IORequest* req = request_of(node);
+        if (n > 0 && (s->policy != IOSCHED_ELEVATOR ||
+                      req->block_no != s->head ||
+                      blocks + req->count > IOSCHED_MAX_MERGE))
+            break;
+        node = node->next;
+        _detach_from_list(&req->node);
+        s->batch[n++] = req;
+        blocks += req->count;
+        s->head = req->block_no + req->count;
+    }
+    s->batch_size = n;
+}
+
+// dispatch the next batch if the device is idle. must hold the lock, which
+// is released.
+static void start_next(IOScheduler* s) {
+    if (s->busy)
+        goto out;
+
+    bool reads = !_empty_list(&s->reads), writes = !_empty_list(&s->writes);
+    if (reads && (!writes || s->read_batches < IOSCHED_READ_BATCHES)) {
+        take_batch(s, &s->reads);
+        s->read_batches = writes ? s->read_batches + 1 : 0;
+    } else if (writes) {
+        take_batch(s, &s->writes);
+        s->read_batches = 0;
+    } else
+        goto out;
+
+    s->busy = true;
+    s->dispatches++;
+    _release_spinlock(&s->lock);
+    s->dispatch(s, s->batch, s->batch_size);
+    return;
+
+out:
+    _release_spinlock(&s->lock);
+}
+
+void iosched_submit(IOScheduler* s, IORequest* req) {
+    init_sem(&req->done, 0);
+    _acquire_spinlock(&s->lock);
+    queue_request(s, req);
+    start_next(s);
+}
+
+void iosched_rw(IOScheduler* s, IORequest* req) {
+    req->end_io = NULL;
+    iosched_submit(s, req);
+    iosched_wait(req);
+}
+
+bool iosched_poll(IORequest* req) {
+    _lock_sem(&req->done);
+    bool completed = _query_sem(&req->done) > 0;
+    _unlock_sem(&req->done);
+    return completed;
+}
+
+void iosched_wait(IORequest* req) {
+    unalertable_wait_sem(&req->done);
+}
+
+void iosched_complete(IORequest* req) {
+    if (req->end_io)
+        req->end_io(req);
+    else
+        post_sem(&req->done);
+}
+
+void iosched_done(IOScheduler* s) {
+    // the batch is left alone until the scheduler is idle, and the lock is
+    // not held so that `end_io` can submit more requests.
+    for (usize i = 0; i < s->batch_size; i++)
+        iosched_complete(s->batch[i]);
+    _acquire_spinlock(&s->lock);
+    s->batch_size = 0;
+    s->busy = false;
+    start_next(s);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <common/list.h>
+#include <common/sem.h>
+#include <fs/defines.h>
+
+// most blocks moved by one dispatched transfer.
+#define IOSCHED_MAX_MERGE 128
+
+// read batches dispatched in a row while writes are waiting. the writes
+// go next, so background write-back is delayed but never starved.
+#define IOSCHED_READ_BATCHES 4
+
+typedef enum {
+    IOSCHED_FIFO,      // arrival order, one request per transfer.
+    IOSCHED_ELEVATOR,  // sorted by block number, adjacent ones merged.
+} IOSchedPolicy;
+
+// a transfer of `count` consecutive blocks from `block_no` to or from
+// `buffer`, which holds `count * BLOCK_SIZE` bytes.
+typedef struct IORequest {
+    usize block_no;
+    usize count;
+    u8* buffer;
+    bool write;
+    // if not NULL, called when the transfer is complete, maybe from the
+    // interrupt handler. the request then belongs to `end_io`, and `done`
+    // is not posted, so nobody may wait for it.
+    void (*end_io)(struct IORequest* req);
+    void* arg;  // for `end_io`.
+    ListNode node;
+    Semaphore done;  // posted when the transfer is complete.
+} IORequest;
+
+typedef struct IOScheduler {
+    SpinLock lock;
+    IOSchedPolicy policy;
+    // pending requests. reads go before writes, see `IOSCHED_READ_BATCHES`.
+    // with `IOSCHED_ELEVATOR` both lists are sorted by block number.
+    ListNode reads, writes;
+    usize head;          // the block after the last dispatched one.
+    usize read_batches;  // read batches in a row while writes wait.
+    bool busy;           // is a batch in flight?
+    IORequest* batch[IOSCHED_MAX_MERGE];
+    usize batch_size;
+
+    // start the transfer of the `n` requests of `batch`. they have the same
+    // direction and each one starts at the block after the previous one.
+    // `iosched_done` must be called once the transfer is complete. it can
+    // be called from an interrupt handler, without the lock.
+    void (*dispatch)(struct IOScheduler* s, IORequest** batch, usize n);
+
+    // for statistics.
+    usize requests, dispatches;
+} IOScheduler;
+
+void init_iosched(IOScheduler* s,
+                  IOSchedPolicy policy,
+                  void (*dispatch)(IOScheduler*, IORequest**, usize));
+
+// queue `req` and return. once it is transferred, `req->end_io` is called
+// or `req->done` is posted.
+void iosched_submit(IOScheduler* s, IORequest* req);
+
+// queue `req` and wait for it.
+void iosched_rw(IOScheduler* s, IORequest* req);
+
+// is the transfer of `req` complete? `req` must have no `end_io`, and it
+// must still be waited for before it is reused.
+bool iosched_poll(IORequest* req);
+
+// wait for `req`, which must have no `end_io`.
+void iosched_wait(IORequest* req);
+
+// the transfer of `req` is complete: run its `end_io` or post `done`.
+// `iosched_done` calls it for the requests of the batch.
+void iosched_complete(IORequest* req);
+
+// the dispatched batch is complete: finish its requests and dispatch the
+// next one.
+void iosched_done(IOScheduler* s);
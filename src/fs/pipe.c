@@ -50,13 +50,14 @@ int pipeAlloc(File** f0, File** f1) {
 void pipeClose(Pipe* pi, int writable) {
     //关闭`pipe`的一端。如果检测到两端都关闭，则释放`pipe`空间。
     _acquire_spinlock(&pi->lock);
+    //另一端的所有等待者都需要醒来
     if (writable) {
         pi->writeopen = 0;
-        _post_sem(&pi->rlock);
+        post_all_sem(&pi->rlock);
     }
     else {
         pi->readopen = 0;
-        _post_sem(&pi->wlock);
+        post_all_sem(&pi->wlock);
     }
 
     if (pi->readopen == 0 && pi->writeopen == 0) {
@@ -81,10 +82,10 @@ int pipeWrite(Pipe* pi, u64 addr, int n) {
         }
 
         //如果缓冲区满了则sleep
+        //条件在pi->lock下检查，唤醒者也持有pi->lock，所以只需唤醒一个
         if (pi->nwrite == pi->nread + PIPESIZE) {
-            post_all_sem(&pi->rlock);
+            wake_sem(&pi->rlock, 1);
 
-            get_all_sem(&pi->wlock);
             _lock_sem(&pi->wlock);
             _release_spinlock(&pi->lock);
             //sleep
@@ -96,7 +97,11 @@ int pipeWrite(Pipe* pi, u64 addr, int n) {
             i++;
         }
     }
-    post_all_sem(&pi->rlock);
+    wake_sem(&pi->rlock, 1);
+    //还有空间，让下一个写者继续
+    if (pi->nwrite < pi->nread + PIPESIZE) {
+        wake_sem(&pi->wlock, 1);
+    }
     _release_spinlock(&pi->lock);
     return i;
 }
@@ -114,7 +119,6 @@ int pipeRead(Pipe* pi, u64 addr, int n) {
             return -1;
         }
         //sleep
-        get_all_sem(&pi->rlock);
         _lock_sem(&pi->rlock);
         _release_spinlock(&pi->lock);
         ASSERT(_wait_sem(&pi->rlock, false));
@@ -128,7 +132,11 @@ int pipeRead(Pipe* pi, u64 addr, int n) {
         *(char*)(addr + i) = pi->data[pi->nread++ % PIPESIZE]; 
     }
     
-    post_all_sem(&pi->wlock);
+    wake_sem(&pi->wlock, 1);
+    //还有数据，让下一个读者继续
+    if (pi->nread < pi->nwrite) {
+        wake_sem(&pi->rlock, 1);
+    }
     _release_spinlock(&pi->lock);
     return i;
 }
\ No newline at end of file
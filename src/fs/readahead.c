@@ -0,0 +1,75 @@
+#include <common/sem.h>
+#include <common/spinlock.h>
+#include <fs/cache.h>
+#include <fs/file.h>
+#include <fs/readahead.h>
+#include <kernel/proc.h>
+#include <kernel/sched.h>
+
+extern BlockCache bcache;
+extern InodeTree inodes;
+
+static struct {
+    SpinLock lock;
+    Semaphore sem;  // counts the queued blocks
+    usize head, tail;
+    usize block_no[READAHEAD_QUEUE];
+} queue;
+
+static void push_block(usize block_no) {
+    _acquire_spinlock(&queue.lock);
+    if (queue.tail - queue.head < READAHEAD_QUEUE) {
+        queue.block_no[queue.tail++ % READAHEAD_QUEUE] = block_no;
+        post_sem(&queue.sem);
+    }
+    _release_spinlock(&queue.lock);
+}
+
+// the read-ahead thread, which submits the reads for the readers. they are
+// not waited for, so the queued blocks go to the device together.
+static void readahead_entry(u64 arg) {
+    (void)arg;
+    while (1) {
+        unalertable_wait_sem(&queue.sem);
+        _acquire_spinlock(&queue.lock);
+        usize block_no = queue.block_no[queue.head++ % READAHEAD_QUEUE];
+        _release_spinlock(&queue.lock);
+        bcache.prefetch(block_no);
+    }
+}
+
+void init_readahead() {
+    init_spinlock(&queue.lock);
+    init_sem(&queue.sem, 0);
+    queue.head = queue.tail = 0;
+    auto p = create_proc();
+    set_parent_to_this(p);
+    start_proc(p, readahead_entry, 0);
+}
+
+void readahead(Inode* inode, usize offset, usize count) {
+    usize end = MIN(offset + count, (usize)inode->entry.num_bytes);
+    for (usize off = offset - offset % BLOCK_SIZE; off < end; off += BLOCK_SIZE) {
+        usize block_no = inodes.bmap(inode, off);
+        if (block_no)
+            push_block(block_no);
+    }
+}
+
+void file_readahead(struct file* f, usize count) {
+    if (f->ip->entry.type != INODE_REGULAR)
+        return;
+    if (f->off != f->ra_off) {
+        // a seek, start over
+        f->ra_window = 0;
+        f->ra_next = 0;
+        return;
+    }
+    f->ra_window = f->ra_window ? MIN(f->ra_window * 2, (usize)READAHEAD_MAX) : READAHEAD_MIN;
+    usize start = MAX(f->off + count, f->ra_next);
+    usize end = f->off + count + f->ra_window * BLOCK_SIZE;
+    if (start < end) {
+        readahead(f->ip, start, end - start);
+        f->ra_next = end;
+    }
+}
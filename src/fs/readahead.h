@@ -0,0 +1,25 @@
+#pragma once
+
+#include <fs/inode.h>
+
+// the read-ahead window of a sequential reader, in blocks. it starts at
+// the minimum and doubles on every sequential read up to the maximum.
+#define READAHEAD_MIN 4
+#define READAHEAD_MAX 32
+
+// queued blocks not yet read by the read-ahead thread. more are dropped.
+#define READAHEAD_QUEUE 256
+
+struct file;
+
+void init_readahead();
+
+// queue the mapped blocks of `count` bytes of `inode` from `offset` to be
+// read into the block cache in the background.
+// NOTE: caller must hold the lock of `inode`.
+void readahead(Inode* inode, usize offset, usize count);
+
+// called before reading `count` bytes at the offset of `f`. if the read
+// continues the previous one, read ahead a window of blocks behind it.
+// NOTE: caller must hold the lock of `f->ip`.
+void file_readahead(struct file* f, usize count);
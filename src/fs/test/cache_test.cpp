@@ -171,6 +171,7 @@ void test_atomic_op() {
 
     assert_eq(d[128], v);
     bcache.end_op(&ctx);
+    checkpoint_log();
     assert_eq(d[128], ~v);
 
     bcache.begin_op(&ctx);
@@ -197,6 +198,7 @@ void test_atomic_op() {
     assert_eq(d1[500], v1);
     assert_eq(d2[10], v2);
     bcache.end_op(&ctx);
+    checkpoint_log();
     assert_eq(d1[500], ~v1);
     assert_eq(d2[10], ~v2);
 }
@@ -287,6 +289,7 @@ void test_local_absorption() {
         }
     }
     bcache.end_op(&ctx);
+    checkpoint_log();
 
     assert_true(mock.read_count < OP_MAX_NUM_BLOCKS * 5);
     assert_true(mock.write_count < OP_MAX_NUM_BLOCKS * 5);
@@ -333,6 +336,7 @@ void test_global_absorption() {
     for (auto& worker : workers) {
         worker.join();
     }
+    checkpoint_log();
     for (usize i = 0; i < op_size; i++) {
         auto* b = mock.inspect(t - i);
         assert_eq(b[0], 0xdd);
@@ -344,6 +348,45 @@ void test_global_absorption() {
     }
 }
 
+// targets: `prefetch`, asynchronous write-back.
+
+void test_async_io() {
+    initialize(100, 100);
+    usize t = sblock.num_blocks - 1;
+
+    usize read_count = mock.read_count;
+    bcache.prefetch(t);
+    bcache.prefetch(t);
+    auto* b = bcache.acquire(t);
+    assert_eq(b->valid, true);
+    assert_eq(mock.read_count, read_count + 1);
+    for (usize i = 0; i < BLOCK_SIZE; i++) {
+        assert_eq(b->data[i], mock.inspect(t)[i]);
+    }
+    bcache.release(b);
+
+    OpContext ctx;
+    bcache.begin_op(&ctx);
+    for (usize j = 0; j < OP_MAX_NUM_BLOCKS; j++) {
+        b = bcache.acquire(t - j);
+        b->data[0] = 0xcd;
+        bcache.sync(&ctx, b);
+        bcache.release(b);
+    }
+    bcache.end_op(&ctx);
+    checkpoint_log();
+    for (usize j = 0; j < OP_MAX_NUM_BLOCKS; j++) {
+        assert_eq(mock.inspect(t - j)[0], 0xcd);
+    }
+
+    // the checkpoint submits all the blocks before waiting.
+    BlockCacheStat st;
+    get_bcache_stat(&st);
+    assert_eq(st.io_depth, 0);
+    assert_eq(st.max_io_depth, OP_MAX_NUM_BLOCKS);
+    assert_eq(st.io_requests, 1 + 1 + OP_MAX_NUM_BLOCKS);
+}
+
 // target: replay at initialization.
 
 void test_replay() {
@@ -394,6 +437,7 @@ void test_alloc() {
         bcache.release(b);
 
         bcache.end_op(&ctx);
+        checkpoint_log();
         auto* d = mock.inspect(bno[i]);
         for (usize j = 0; j < BLOCK_SIZE; j++) {
             assert_eq(d[j], 0);
@@ -465,6 +509,23 @@ void test_alloc_free() {
     }
 }
 
+void test_alloc_near() {
+    initialize(100, 1000);
+
+    OpContext ctx;
+    bcache.begin_op(&ctx);
+    usize first = bcache.alloc(&ctx);
+    usize goal = first + 500;
+    assert_eq(bcache.alloc_near(&ctx, goal), goal);
+    assert_eq(bcache.alloc_near(&ctx, goal), goal + 1);
+    assert_eq(bcache.alloc_near(&ctx, goal - 1), goal - 1);
+    // a goal past the data blocks starts over from the first free block.
+    assert_eq(bcache.alloc_near(&ctx, sblock.num_blocks), first + 1);
+    bcache.free(&ctx, goal);
+    assert_eq(bcache.alloc_near(&ctx, goal - 1), goal);
+    bcache.end_op(&ctx);
+}
+
 }  // namespace basic
 
 namespace concurrent {
@@ -564,6 +625,7 @@ void test_sync() {
             if (j > 0)
                 check(j - 1);
             bcache.end_op(&ctx);
+            checkpoint_log();
             check(j);
         }
     }
@@ -619,6 +681,7 @@ void test_simple_crash() {
         bcache.sync(&ctx, b);
         bcache.release(b);
         bcache.end_op(&ctx);
+        checkpoint_log();
 
         bcache.begin_op(&ctx);
         b = bcache.acquire(150);
@@ -880,6 +943,218 @@ void test_banker() {
 
 }  // namespace crash
 
+namespace bench {
+
+// lookup throughput when every acquire hits the cache.
+void test_lookup() {
+    constexpr usize num_lookups = 1000000;
+
+    for (usize num_cached : {20, 1000, 65536}) {
+        initialize(1, num_cached);
+
+        // blocks that are acquired can not be evicted, so the cache grows to
+        // hold all of them.
+        std::vector<Block*> p(num_cached);
+        usize first = sblock.num_blocks - num_cached;
+        for (usize i = 0; i < num_cached; i++) {
+            p[i] = bcache.acquire(first + i);
+        }
+        for (auto* b : p) {
+            bcache.release(b);
+        }
+        assert_eq(bcache.get_num_cached_blocks(), num_cached);
+
+        std::mt19937 gen(0xdeadbeef);
+        usize read_count = mock.read_count;
+        auto t0 = std::chrono::steady_clock::now();
+        for (usize i = 0; i < num_lookups; i++) {
+            auto* b = bcache.acquire(first + gen() % num_cached);
+            bcache.release(b);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        assert_eq(mock.read_count, read_count);
+
+        double sec = std::chrono::duration<double>(t1 - t0).count();
+        printf("(debug) %zu cached blocks: %.2f M lookups/s\n", num_cached,
+               num_lookups / sec / 1e6);
+    }
+}
+
+// a hot set interleaved with bursts of sequential scan, like hot inode and
+// bitmap blocks between reads of large files.
+void test_scan() {
+    constexpr usize hot_size = EVICTION_THRESHOLD * 0.6;
+    constexpr usize scan_size = 10000;
+    constexpr usize num_rounds = 200;
+    constexpr usize hot_per_round = 100;
+    constexpr usize scan_per_round = 50;
+
+    double ratio[2];
+    for (int policy : {BCACHE_LRU, BCACHE_2Q}) {
+        initialize(1, hot_size + scan_size);
+        set_bcache_policy(policy);
+        BlockCacheStat st0;
+        get_bcache_stat(&st0);
+
+        std::mt19937 gen(0xdeadbeef);
+        usize scan = 0;
+        for (usize round = 0; round < num_rounds; round++) {
+            for (usize i = 0; i < hot_per_round; i++) {
+                bcache.release(bcache.acquire(gen() % hot_size));
+            }
+            for (usize i = 0; i < scan_per_round; i++) {
+                bcache.release(bcache.acquire(hot_size + scan));
+                scan = (scan + 1) % scan_size;
+            }
+        }
+
+        BlockCacheStat st;
+        get_bcache_stat(&st);
+        assert_true(st.num_cached <= EVICTION_THRESHOLD);
+        usize hits = st.hits - st0.hits, misses = st.misses - st0.misses;
+        ratio[policy] = (double)hits / (hits + misses);
+        printf("(debug) %s: hit ratio %.3f, %zu evictions\n",
+               policy == BCACHE_LRU ? "LRU" : "2Q", ratio[policy], st.evictions);
+    }
+    assert_true(ratio[BCACHE_2Q] > ratio[BCACHE_LRU]);
+}
+
+// writers on disjoint blocks, with a device that takes a while to write.
+// ops of the next transaction should run while the last one is committed.
+void test_writers() {
+    using namespace std::chrono_literals;
+
+    constexpr usize op_size = 3;
+    constexpr usize num_ops = 300;
+
+    for (usize num_workers : {1, 2, 4, 8}) {
+        initialize(LOG_MAX_SIZE, num_workers * op_size);
+        mock.on_write = [](usize, u8*) { std::this_thread::sleep_for(20us); };
+        usize t = sblock.num_blocks - num_workers * op_size;
+        usize write_count = mock.write_count;
+
+        std::vector<std::thread> workers;
+        auto t0 = std::chrono::steady_clock::now();
+        for (usize i = 0; i < num_workers; i++) {
+            workers.emplace_back([&, i] {
+                for (usize v = 1; v <= num_ops; v++) {
+                    OpContext ctx;
+                    bcache.begin_op(&ctx);
+                    for (usize j = 0; j < op_size; j++) {
+                        auto* b = bcache.acquire(t + i * op_size + j);
+                        *reinterpret_cast<usize*>(b->data) = v;
+                        bcache.sync(&ctx, b);
+                        bcache.release(b);
+                    }
+                    bcache.end_op(&ctx);
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        mock.on_write = nullptr;
+        checkpoint_log();
+
+        for (usize i = 0; i < num_workers * op_size; i++) {
+            assert_eq(*reinterpret_cast<usize*>(mock.inspect(t + i)), num_ops);
+        }
+        double sec = std::chrono::duration<double>(t1 - t0).count();
+        usize num_txns = num_workers * num_ops;
+        printf("(debug) %zu writers: %.0f ops/s, %.2f device writes/op\n", num_workers,
+               num_txns / sec, (double)(mock.write_count - write_count) / num_txns);
+    }
+}
+
+// each op updates two hot blocks, like an inode and a bitmap block, and
+// appends a data block. the hot blocks should be written home once per
+// checkpoint rather than once per op.
+void test_amplification() {
+    constexpr usize num_data = 1000;
+    constexpr usize num_ops = 3000;
+
+    initialize(LOG_MAX_SIZE, 2 + num_data);
+    usize t = sblock.num_blocks - 2 - num_data;
+    BlockCacheStat st0;
+    get_bcache_stat(&st0);
+    usize write_count = mock.write_count;
+
+    for (usize i = 1; i <= num_ops; i++) {
+        OpContext ctx;
+        bcache.begin_op(&ctx);
+        for (usize bno : {t, t + 1, t + 2 + i % num_data}) {
+            auto* b = bcache.acquire(bno);
+            *reinterpret_cast<usize*>(b->data) = i;
+            bcache.sync(&ctx, b);
+            bcache.release(b);
+        }
+        bcache.end_op(&ctx);
+    }
+    checkpoint_log();
+
+    assert_eq(*reinterpret_cast<usize*>(mock.inspect(t)), num_ops);
+    assert_eq(*reinterpret_cast<usize*>(mock.inspect(t + 1)), num_ops);
+    BlockCacheStat st;
+    get_bcache_stat(&st);
+    usize logical = st.logical_writes - st0.logical_writes;
+    usize written = st.device_writes - st0.device_writes;
+    assert_eq(logical, 3 * num_ops);
+    assert_eq(written, mock.write_count - write_count);
+    printf("(debug) %zu logical writes, %zu device writes, amplification %.2f\n", logical,
+           written, (double)written / logical);
+}
+
+// a file grows on a disk whose data blocks are 90% taken at random.
+void test_alloc() {
+    constexpr usize num_data_blocks = 20000;
+    constexpr usize ops_size = 4;
+
+    initialize_mock(100, num_data_blocks);
+    usize start = sblock.num_blocks - num_data_blocks;
+    usize limit = sblock.num_blocks - SWAP_BLOCK_NUM;
+    std::mt19937 gen(0x19260817);
+    std::vector<u8> used(sblock.num_blocks);
+    usize num_free = 0;
+    for (usize i = start; i < limit; i++) {
+        if (gen() % 10 == 0) {
+            num_free++;
+            continue;
+        }
+        used[i] = true;
+        mock.inspect(sblock.bitmap_start + i / BIT_PER_BLOCK)[i % BIT_PER_BLOCK / 8] |=
+            (u8)(1 << (i % 8));
+    }
+    init_bcache(&sblock, &device);
+
+    usize num_allocs = num_free / 2 / ops_size * ops_size;
+    usize goal = 0, num_runs = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (usize i = 0; i < num_allocs; i += ops_size) {
+        OpContext ctx;
+        bcache.begin_op(&ctx);
+        for (usize j = 0; j < ops_size; j++) {
+            usize b = bcache.alloc_near(&ctx, goal);
+            assert_true(b >= start && b < limit);
+            assert_eq(used[b], 0);
+            used[b] = true;
+            if (b != goal)
+                num_runs++;
+            goal = b + 1;
+        }
+        bcache.end_op(&ctx);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+    // every allocation with the goal taken skips the used blocks, and stays
+    // in order.
+    assert_true(goal > start + num_data_blocks / 3);
+    printf("(debug) %zu allocs in %zu runs, %.0f allocs/s\n", num_allocs, num_runs,
+           num_allocs * 1e6 / (double)std::max<long>(us, 1));
+}
+
+}  // namespace bench
+
 int main() {
     std::vector<Testcase> tests = {
         {"init", basic::test_init},
@@ -892,9 +1167,11 @@ int main() {
         {"resident", basic::test_resident},
         {"local_absorption", basic::test_local_absorption},
         {"global_absorption", basic::test_global_absorption},
+        {"async_io", basic::test_async_io},
         {"replay", basic::test_replay},
         {"alloc", basic::test_alloc},
         {"alloc_free", basic::test_alloc_free},
+        {"alloc_near", basic::test_alloc_near},
 
         {"concurrent_acquire", concurrent::test_acquire},
         {"concurrent_sync", concurrent::test_sync},
@@ -907,6 +1184,12 @@ int main() {
         {"parallel_3", [] { crash::test_parallel(500, 4, 10, 1); }},
         {"parallel_4", [] { crash::test_parallel(500, 4, 10, 2 * OP_MAX_NUM_BLOCKS); }},
         {"banker", crash::test_banker},
+
+        {"lookup_bench", bench::test_lookup},
+        {"scan_bench", bench::test_scan},
+        {"writers_bench", bench::test_writers},
+        {"amplification_bench", bench::test_amplification},
+        {"alloc_bench", bench::test_alloc},
     };
     Runner(tests).run();
 
@@ -8,6 +8,10 @@ extern "C" {
 
 #include "mock/cache.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
 void test_init() {
     init_inodes(&sblock, &cache);
     assert_eq(mock.count_inodes(), 1);
@@ -310,6 +314,58 @@ void test_large_file() {
     assert_eq(mock.count_blocks(), 0);
 }
 
+// target: the double indirect block.
+void test_huge_file() {
+    mock.begin_op(ctx);
+    usize ino = inodes.alloc(ctx, INODE_REGULAR);
+    mock.end_op(ctx);
+
+    // a few indirect blocks under the double indirect one.
+    constexpr usize num_blocks = INODE_NUM_DIRECT + INODE_NUM_INDIRECT + 3 * INODE_NUM_INDIRECT + 5;
+    constexpr usize size = num_blocks * BLOCK_SIZE;
+    std::vector<u8> buf(size), copy(size);
+    std::mt19937 gen(0x87654321);
+    for (usize i = 0; i < size; i++) {
+        copy[i] = buf[i] = gen() & 0xff;
+    }
+
+    auto* p = inodes.get(ino);
+    inodes.lock(p);
+    for (usize i = 0, n = 0; i < size; i += n) {
+        n = std::min(static_cast<usize>(gen() % 20000), size - i);
+        mock.begin_op(ctx);
+        inodes.write(ctx, p, buf.data() + i, i, n);
+        mock.end_op(ctx);
+    }
+
+    auto* q = mock.inspect(ino);
+    assert_eq(q->num_bytes, size);
+    assert_ne(q->double_indirect, 0);
+    // data blocks, the indirect block, the double indirect block and the
+    // four indirect blocks under it.
+    assert_eq(mock.count_blocks(), num_blocks + 1 + 1 + 4);
+    assert_eq(inodes.bmap(p, size), 0);
+    assert_ne(inodes.bmap(p, size - 1), 0);
+
+    std::fill(buf.begin(), buf.end(), 0);
+    inodes.read(p, buf.data(), 0, size);
+    for (usize i = 0; i < size; i++) {
+        assert_eq(buf[i], copy[i]);
+    }
+
+    mock.begin_op(ctx);
+    inodes.clear(ctx, p);
+    inodes.unlock(p);
+    mock.end_op(ctx);
+    assert_eq(mock.count_blocks(), 0);
+    assert_eq(q->double_indirect, 0);
+
+    mock.begin_op(ctx);
+    inodes.put(ctx, p);
+    mock.end_op(ctx);
+    assert_eq(mock.count_inodes(), 1);
+}
+
 void test_dir() {
     usize ino[5] = {1};
 
@@ -399,8 +455,503 @@ void test_dir() {
     }
 }
 
+void test_retention() {
+    mock.begin_op(ctx);
+    usize ino = inodes.alloc(ctx, INODE_REGULAR);
+    mock.end_op(ctx);
+
+    InodeCacheStat st0, st;
+    get_inode_cache_stat(&st0);
+    auto* p = inodes.get(ino);
+    mock.begin_op(ctx);
+    inodes.lock(p);
+    p->entry.num_links = 1;
+    inodes.sync(ctx, p, true);
+    inodes.unlock(p);
+    inodes.put(ctx, p);
+    mock.end_op(ctx);
+    get_inode_cache_stat(&st);
+    assert_eq(st.misses, st0.misses + 1);
+    assert_eq(st.num_unused, st0.num_unused + 1);
+
+    // it is revived as it was, without reading the inode block.
+    usize acquires = mock.acquire_count;
+    auto* q = inodes.get(ino);
+    assert_eq(q, p);
+    assert_eq(q->valid, true);
+    assert_eq(q->rc.count, 1);
+    assert_eq(mock.acquire_count, acquires);
+    get_inode_cache_stat(&st);
+    assert_eq(st.hits, st0.hits + 1);
+    assert_eq(st.num_unused, st0.num_unused);
+
+    mock.begin_op(ctx);
+    inodes.put(ctx, q);
+    mock.end_op(ctx);
+    get_inode_cache_stat(&st);
+    assert_eq(reclaim_inodes(st.num_unused), st.num_unused);
+    get_inode_cache_stat(&st);
+    assert_eq(st.num_unused, 0);
+    assert_eq(st.num_cached, st0.num_cached - st0.num_unused);
+
+    // no more than `INODE_CACHE_UNUSED` unreferenced inodes are kept.
+    for (usize i = 2; i < 2 + INODE_CACHE_UNUSED + 10; i++) {
+        mock.begin_op(ctx);
+        usize k = inodes.alloc(ctx, INODE_REGULAR);
+        auto* r = inodes.get(k);
+        inodes.lock(r);
+        r->entry.num_links = 1;
+        inodes.sync(ctx, r, true);
+        inodes.unlock(r);
+        inodes.put(ctx, r);
+        mock.end_op(ctx);
+    }
+    get_inode_cache_stat(&st);
+    assert_eq(st.num_unused, INODE_CACHE_UNUSED);
+}
+
+void test_dcache() {
+    mock.begin_op(ctx);
+    usize dino = inodes.alloc(ctx, INODE_DIRECTORY);
+    usize ino = inodes.alloc(ctx, INODE_REGULAR);
+    mock.end_op(ctx);
+
+    auto* d = inodes.get(dino);
+    inodes.lock(d);
+    DcacheStat st0, st;
+    get_dcache_stat(&st0);
+    assert_eq(inodes.lookup(d, "fudan", NULL), 0);
+    assert_eq(inodes.lookup(d, "fudan", NULL), 0);
+    get_dcache_stat(&st);
+    assert_eq(st.misses, st0.misses + 1);
+    assert_eq(st.negative_hits, st0.negative_hits + 1);
+
+    // the negative entry, which `insert` finds too, is replaced by it.
+    mock.begin_op(ctx);
+    usize index = inodes.insert(ctx, d, "fudan", ino);
+    mock.end_op(ctx);
+    usize index2 = 233;
+    assert_eq(inodes.lookup(d, "fudan", &index2), ino);
+    assert_eq(index2, index);
+    get_dcache_stat(&st);
+    assert_eq(st.hits, st0.hits + 3);
+    assert_eq(st.misses, st0.misses + 1);
+
+    mock.begin_op(ctx);
+    inodes.remove(ctx, d, index);
+    mock.end_op(ctx);
+    assert_eq(inodes.lookup(d, "fudan", NULL), 0);
+
+    mock.begin_op(ctx);
+    inodes.insert(ctx, d, "fudan", ino);
+    inodes.clear(ctx, d);
+    mock.end_op(ctx);
+    get_dcache_stat(&st0);
+    assert_eq(inodes.lookup(d, "fudan", NULL), 0);
+    get_dcache_stat(&st);
+    assert_eq(st.misses, st0.misses + 1);
+
+    inodes.unlock(d);
+    mock.begin_op(ctx);
+    inodes.put(ctx, d);
+    mock.end_op(ctx);
+}
+
+// grow a directory past the linear format, and split its leaves and its
+// index nodes.
+void test_index() {
+    constexpr usize n = 2000;
+    auto name = [](usize i) { return "n" + std::to_string(i); };
+
+    mock.begin_op(ctx);
+    usize dino = inodes.alloc(ctx, INODE_DIRECTORY);
+    mock.end_op(ctx);
+    auto* d = inodes.get(dino);
+    inodes.lock(d);
+
+    mock.begin_op(ctx);
+    for (usize i = 0; i < n; i++)
+        inodes.insert(ctx, d, name(i).data(), i % 100 + 1);
+    mock.end_op(ctx);
+    assert_true(d->entry.num_bytes > DIR_LINEAR_MAX_BLOCKS * BLOCK_SIZE);
+    assert_eq(d->entry.num_bytes % BLOCK_SIZE, 0);
+
+    // entries are where `lookup` says, and a linear read sees only them.
+    for (usize i = 0; i < n; i++) {
+        usize index = 0;
+        assert_eq(inodes.lookup(d, name(i).data(), &index), i % 100 + 1);
+        DirEntry de;
+        inodes.read(d, (u8*)&de, index, sizeof(de));
+        assert_eq(de.inode_no, i % 100 + 1);
+        assert_eq(std::string(de.name), name(i));
+    }
+    assert_eq(inodes.lookup(d, "fudan", NULL), 0);
+    std::vector<DirEntry> all(d->entry.num_bytes / sizeof(DirEntry));
+    inodes.read(d, (u8*)all.data(), 0, d->entry.num_bytes);
+    usize live = 0;
+    for (auto& de : all)
+        live += de.inode_no != 0;
+    assert_eq(live, n);
+
+    mock.begin_op(ctx);
+    for (usize i = 0; i < n; i += 2) {
+        usize index = 0;
+        inodes.lookup(d, name(i).data(), &index);
+        inodes.remove(ctx, d, index);
+    }
+    mock.end_op(ctx);
+    for (usize i = 0; i < n; i++)
+        assert_eq(inodes.lookup(d, name(i).data(), NULL), i % 2 ? i % 100 + 1 : 0);
+
+    // the freed slots are used again.
+    usize size = d->entry.num_bytes;
+    mock.begin_op(ctx);
+    for (usize i = 0; i < n; i += 2)
+        inodes.insert(ctx, d, name(i).data(), 1);
+    mock.end_op(ctx);
+    assert_eq(d->entry.num_bytes, size);
+    for (usize i = 0; i < n; i += 2)
+        assert_eq(inodes.lookup(d, name(i).data(), NULL), 1);
+
+    inodes.unlock(d);
+    mock.begin_op(ctx);
+    inodes.put(ctx, d);
+    mock.end_op(ctx);
+}
+
+// fill a directory until its index is full. `insert` then fails and leaves
+// the directory as it was.
+void test_index_full() {
+    auto name = [](usize i) { return "f" + std::to_string(i); };
+
+    mock.begin_op(ctx);
+    usize dino = inodes.alloc(ctx, INODE_DIRECTORY);
+    mock.end_op(ctx);
+    auto* d = inodes.get(dino);
+    inodes.lock(d);
+
+    usize n = 0;
+    mock.begin_op(ctx);
+    while (inodes.insert(ctx, d, name(n).data(), 1) != (usize)-1) {
+        n++;
+        assert_true(n < 40000);
+    }
+    mock.end_op(ctx);
+    assert_true(n > DX_ROOT_ENTRIES * DX_NODE_ENTRIES * DIR_PER_BLOCK / 2);
+
+    usize size = d->entry.num_bytes;
+    mock.begin_op(ctx);
+    assert_eq(inodes.insert(ctx, d, name(n).data(), 1), (usize)-1);
+    mock.end_op(ctx);
+    assert_eq(d->entry.num_bytes, size);
+    assert_eq(inodes.lookup(d, name(n).data(), NULL), 0);
+    for (usize i = 0; i < n; i++)
+        assert_eq(inodes.lookup(d, name(i).data(), NULL), 1);
+
+    inodes.unlock(d);
+    mock.begin_op(ctx);
+    inodes.put(ctx, d);
+    mock.end_op(ctx);
+}
+
 }  // namespace adhoc
 
+namespace bench {
+
+static OpContext _ctx, *ctx = &_ctx;
+
+// read a 4 MiB file block by block, in order and at random.
+void test_read() {
+    constexpr usize num_blocks = 8192;
+    constexpr usize size = num_blocks * BLOCK_SIZE;
+
+    mock.begin_op(ctx);
+    usize ino = inodes.alloc(ctx, INODE_REGULAR);
+    mock.end_op(ctx);
+
+    std::vector<u8> buf(size);
+    std::mt19937 gen(0x19260817);
+    for (usize i = 0; i < size; i++) {
+        buf[i] = gen() & 0xff;
+    }
+
+    auto* p = inodes.get(ino);
+    inodes.lock(p);
+    constexpr usize chunk = 128 * BLOCK_SIZE;
+    for (usize i = 0; i < size; i += chunk) {
+        mock.begin_op(ctx);
+        inodes.write(ctx, p, buf.data() + i, i, chunk);
+        mock.end_op(ctx);
+    }
+
+    std::vector<usize> order(num_blocks);
+    for (usize i = 0; i < num_blocks; i++) {
+        order[i] = i;
+    }
+    for (int random = 0; random < 2; random++) {
+        if (random)
+            std::shuffle(order.begin(), order.end(), gen);
+        u8 block[BLOCK_SIZE];
+        usize acquires = mock.acquire_count;
+        auto t0 = std::chrono::steady_clock::now();
+        for (usize i : order) {
+            inodes.read(p, block, i * BLOCK_SIZE, BLOCK_SIZE);
+            assert_eq(block[0], buf[i * BLOCK_SIZE]);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        double secs = std::chrono::duration<double>(t1 - t0).count();
+        printf("(debug) %s read: %.1f MiB/s, %.2f acquires/block\n",
+               random ? "random" : "sequential", size / secs / (1 << 20),
+               (double)(mock.acquire_count - acquires) / num_blocks);
+    }
+
+    mock.begin_op(ctx);
+    inodes.clear(ctx, p);
+    inodes.unlock(p);
+    inodes.put(ctx, p);
+    mock.end_op(ctx);
+    assert_eq(mock.count_blocks(), 0);
+}
+
+// append 1 MiB a few blocks per atomic operation, and count the blocks
+// written and acquired for it. a block zeroed by `alloc` is acquired too.
+void test_append() {
+    constexpr usize size = 1 << 20;
+    constexpr usize chunk = 4 * BLOCK_SIZE + BLOCK_SIZE / 2;
+
+    mock.begin_op(ctx);
+    usize ino = inodes.alloc(ctx, INODE_REGULAR);
+    mock.end_op(ctx);
+
+    std::vector<u8> buf(size);
+    std::mt19937 gen(0x19260817);
+    for (usize i = 0; i < size; i++) {
+        buf[i] = gen() & 0xff;
+    }
+
+    auto* p = inodes.get(ino);
+    inodes.lock(p);
+    usize acquires = mock.acquire_count, syncs = mock.sync_count;
+    usize bitmaps = mock.bitmap_count, zeros = mock.zero_count;
+    for (usize i = 0; i < size; i += chunk) {
+        usize n = std::min(chunk, size - i);
+        mock.begin_op(ctx);
+        assert_eq(inodes.write(ctx, p, buf.data() + i, i, n), n);
+        mock.end_op(ctx);
+
+        // a new block that is partly written is zeroed after the data.
+        if (i == 0) {
+            auto* b = mock.acquire(inodes.bmap(p, n - 1));
+            for (usize j = n % BLOCK_SIZE; j < BLOCK_SIZE; j++)
+                assert_eq(b->data[j], 0);
+            mock.release(b);
+        }
+    }
+    acquires = mock.acquire_count - acquires;
+    syncs = mock.sync_count - syncs;
+    bitmaps = mock.bitmap_count - bitmaps;
+    zeros = mock.zero_count - zeros;
+
+    u8 block[BLOCK_SIZE];
+    for (usize i = 0; i < size; i += BLOCK_SIZE) {
+        assert_eq(inodes.read(p, block, i, BLOCK_SIZE), BLOCK_SIZE);
+        for (usize j = 0; j < BLOCK_SIZE; j++)
+            assert_eq(block[j], buf[i + j]);
+    }
+    printf("(debug) append per MiB: %zu blocks written (%zu synced, %zu bitmap updates, "
+           "%zu zeroed), %zu acquired\n",
+           syncs + bitmaps + zeros, syncs, bitmaps, zeros, acquires + zeros);
+
+    mock.begin_op(ctx);
+    inodes.clear(ctx, p);
+    inodes.unlock(p);
+    inodes.put(ctx, p);
+    mock.end_op(ctx);
+    assert_eq(mock.count_blocks(), 0);
+}
+
+// list a tree of directories recursively and stat every file, like
+// `ls -R`, a few times in a row.
+static void list(Inode* dir) {
+    DirEntry entry;
+    for (usize offset = 0; offset < dir->entry.num_bytes; offset += sizeof(entry)) {
+        inodes.read(dir, (u8*)&entry, offset, sizeof(entry));
+        if (entry.inode_no == 0)
+            continue;
+        auto* p = inodes.get(entry.inode_no);
+        inodes.lock(p);
+        if (p->entry.type == INODE_DIRECTORY)
+            list(p);
+        inodes.unlock(p);
+        inodes.put(ctx, p);
+    }
+}
+
+void test_list() {
+    constexpr usize num_dirs = 8, num_files = 12;
+
+    auto* root = inodes.get(1);
+    inodes.lock(root);
+    for (usize i = 0; i < num_dirs; i++) {
+        mock.begin_op(ctx);
+        usize dino = inodes.alloc(ctx, INODE_DIRECTORY);
+        inodes.insert(ctx, root, ("d" + std::to_string(i)).data(), dino);
+        auto* d = inodes.get(dino);
+        inodes.lock(d);
+        d->entry.num_links = 1;
+        inodes.sync(ctx, d, true);
+        mock.end_op(ctx);
+        for (usize j = 0; j < num_files; j++) {
+            mock.begin_op(ctx);
+            usize ino = inodes.alloc(ctx, INODE_REGULAR);
+            inodes.insert(ctx, d, ("f" + std::to_string(j)).data(), ino);
+            auto* f = inodes.get(ino);
+            inodes.lock(f);
+            f->entry.num_links = 1;
+            inodes.sync(ctx, f, true);
+            inodes.unlock(f);
+            inodes.put(ctx, f);
+            mock.end_op(ctx);
+        }
+        inodes.unlock(d);
+        inodes.put(ctx, d);
+    }
+
+    // start cold.
+    reclaim_inodes(INODE_CACHE_UNUSED);
+    for (int round = 0; round < 3; round++) {
+        InodeCacheStat st0, st;
+        get_inode_cache_stat(&st0);
+        list(root);
+        get_inode_cache_stat(&st);
+        usize hits = st.hits - st0.hits, misses = st.misses - st0.misses;
+        assert_eq(hits + misses, num_dirs * (num_files + 1));
+        if (round > 0)
+            assert_eq(misses, 0);
+        printf("(debug) ls -R round %d: %zu inodes, hit rate %.3f\n", round, hits + misses,
+               (double)hits / (hits + misses));
+    }
+    inodes.unlock(root);
+    mock.begin_op(ctx);
+    inodes.put(ctx, root);
+    mock.end_op(ctx);
+}
+
+// open a path 5 levels deep over and over. every directory on the way has
+// other entries before the next one.
+void test_path() {
+    constexpr usize depth = 5, num_siblings = 40, num_opens = 10000;
+
+    auto* d = inodes.get(1);
+    std::string path;
+    usize target = 0;
+    for (usize i = 0; i < depth; i++) {
+        inodes.lock(d);
+        mock.begin_op(ctx);
+        for (usize j = 0; j < num_siblings; j++)
+            inodes.insert(ctx, d, ("s" + std::to_string(j)).data(), 1);
+        std::string name = "d" + std::to_string(i);
+        target = inodes.alloc(ctx, i + 1 < depth ? INODE_DIRECTORY : INODE_REGULAR);
+        inodes.insert(ctx, d, name.data(), target);
+        mock.end_op(ctx);
+        inodes.unlock(d);
+        mock.begin_op(ctx);
+        inodes.put(ctx, d);
+        d = inodes.get(target);
+        inodes.lock(d);
+        d->entry.num_links = 1;
+        inodes.sync(ctx, d, true);
+        inodes.unlock(d);
+        mock.end_op(ctx);
+        path += "/" + name;
+    }
+    mock.begin_op(ctx);
+    inodes.put(ctx, d);
+    mock.end_op(ctx);
+
+    // look up other names until the path falls out of the cache.
+    auto* root = inodes.get(1);
+    inodes.lock(root);
+    for (usize i = 0; i < DCACHE_SIZE; i++)
+        assert_eq(inodes.lookup(root, ("x" + std::to_string(i)).data(), NULL), 0);
+    inodes.unlock(root);
+
+    for (int warm = 0; warm < 2; warm++) {
+        usize n = warm ? num_opens : 1;
+        usize acquires = mock.acquire_count;
+        DcacheStat st0, st;
+        get_dcache_stat(&st0);
+        mock.begin_op(ctx);
+        auto t0 = std::chrono::steady_clock::now();
+        for (usize i = 0; i < n; i++) {
+            auto* p = namei(path.data(), ctx);
+            assert_eq(p->inode_no, target);
+            inodes.put(ctx, p);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        mock.end_op(ctx);
+        get_dcache_stat(&st);
+        double secs = std::chrono::duration<double>(t1 - t0).count();
+        usize hits = st.hits - st0.hits, misses = st.misses - st0.misses;
+        printf("(debug) %s open of %s: %.0f opens/s, %.1f acquires/open, hit rate %.3f\n",
+               warm ? "warm" : "cold", path.data(), n / secs,
+               (double)(mock.acquire_count - acquires) / n, (double)hits / (hits + misses));
+    }
+
+    mock.begin_op(ctx);
+    inodes.put(ctx, root);
+    mock.end_op(ctx);
+}
+
+// create, then look up, every name of directories of growing size.
+void test_dir() {
+    for (usize n : {100, 1000, 10000}) {
+        auto name = [](usize i) { return "e" + std::to_string(i); };
+
+        mock.begin_op(ctx);
+        usize dino = inodes.alloc(ctx, INODE_DIRECTORY);
+        mock.end_op(ctx);
+        auto* d = inodes.get(dino);
+        inodes.lock(d);
+
+        usize acquires = mock.acquire_count;
+        auto t0 = std::chrono::steady_clock::now();
+        for (usize i = 0; i < n; i += 100) {
+            mock.begin_op(ctx);
+            for (usize j = i; j < std::min(i + 100, n); j++)
+                inodes.insert(ctx, d, name(j).data(), 1);
+            mock.end_op(ctx);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        usize create_acquires = mock.acquire_count - acquires;
+
+        std::vector<usize> order(n);
+        for (usize i = 0; i < n; i++)
+            order[i] = i;
+        std::shuffle(order.begin(), order.end(), std::mt19937(0x19260817));
+        acquires = mock.acquire_count;
+        auto t2 = std::chrono::steady_clock::now();
+        for (usize i : order)
+            assert_eq(inodes.lookup(d, name(i).data(), NULL), 1);
+        auto t3 = std::chrono::steady_clock::now();
+        usize lookup_acquires = mock.acquire_count - acquires;
+
+        double create_secs = std::chrono::duration<double>(t1 - t0).count();
+        double lookup_secs = std::chrono::duration<double>(t3 - t2).count();
+        printf("(debug) %zu entries in %u blocks: %.0f creates/s, %.1f acquires/create, "
+               "%.0f lookups/s, %.1f acquires/lookup\n",
+               n, d->entry.num_bytes / BLOCK_SIZE, n / create_secs,
+               (double)create_acquires / n, n / lookup_secs, (double)lookup_acquires / n);
+
+        inodes.unlock(d);
+        mock.begin_op(ctx);
+        inodes.put(ctx, d);
+        mock.end_op(ctx);
+    }
+}
+
+}  // namespace bench
+
 int main() {
     if (Runner::run({"init", test_init}))
         init_inodes(&sblock, &cache);
@@ -414,7 +965,18 @@ int main() {
         {"share", adhoc::test_share},
         {"small_file", adhoc::test_small_file},
         {"large_file", adhoc::test_large_file},
+        {"huge_file", adhoc::test_huge_file},
         {"dir", adhoc::test_dir},
+        {"retention", adhoc::test_retention},
+        {"dcache", adhoc::test_dcache},
+        {"index", adhoc::test_index},
+        {"index_full", adhoc::test_index_full},
+
+        {"read_bench", bench::test_read},
+        {"append_bench", bench::test_append},
+        {"list_bench", bench::test_list},
+        {"path_bench", bench::test_path},
+        {"dir_bench", bench::test_dir},
     };
     Runner(tests).run();
 
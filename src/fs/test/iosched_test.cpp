@@ -0,0 +1,219 @@
+extern "C" {
+#include <fs/iosched.h>
+}
+
+#include "assert.hpp"
+#include "runner.hpp"
+
+#include "mock/block_device.hpp"
+
+#include <array>
+#include <random>
+
+namespace {
+
+// the simulated device runs one batch at a time, when `step` is called.
+static IOScheduler sched;
+static IORequest** inflight;
+static usize inflight_size;
+static usize num_commands;
+
+static void dispatch(IOScheduler*, IORequest** batch, usize n) {
+    inflight = batch;
+    inflight_size = n;
+}
+
+static void initialize_sched(IOSchedPolicy policy) {
+    initialize_mock(1, 4096);
+    init_iosched(&sched, policy, dispatch);
+    inflight = nullptr;
+    inflight_size = 0;
+    num_commands = 0;
+}
+
+// transfer the batch in flight. returns false if the device is idle.
+static bool step() {
+    if (!inflight)
+        return false;
+    IORequest** batch = inflight;
+    usize n = inflight_size;
+    inflight = nullptr;
+    num_commands++;
+    for (usize i = 0; i < n; i++) {
+        IORequest* req = batch[i];
+        for (usize j = 0; j < req->count; j++) {
+            if (req->write)
+                mock.write(req->block_no + j, req->buffer + j * BLOCK_SIZE);
+            else
+                mock.read(req->block_no + j, req->buffer + j * BLOCK_SIZE);
+        }
+    }
+    iosched_done(&sched);
+    return true;
+}
+
+struct Request {
+    IORequest req;
+    std::array<u8, BLOCK_SIZE> buffer;
+
+    void submit(usize block_no, bool write) {
+        req.block_no = block_no;
+        req.count = 1;
+        req.buffer = buffer.data();
+        req.write = write;
+        req.end_io = nullptr;
+        iosched_submit(&sched, &req);
+    }
+};
+
+}  // namespace
+
+namespace basic {
+
+void test_merge() {
+    initialize_sched(IOSCHED_ELEVATOR);
+
+    Request r[4];
+    r[0].submit(100, false);
+    assert_eq(inflight_size, 1);
+    r[1].submit(10, false);
+    r[2].submit(12, false);
+    r[3].submit(11, false);
+
+    step();
+    assert_eq(inflight_size, 3);
+    assert_eq(inflight[0]->block_no, 10);
+    assert_eq(inflight[1]->block_no, 11);
+    assert_eq(inflight[2]->block_no, 12);
+    step();
+    assert_eq(step(), false);
+
+    for (auto& x : r) {
+        assert_eq(get_sem(&x.req.done), true);
+        for (usize i = 0; i < BLOCK_SIZE; i++)
+            assert_eq(x.buffer[i], mock.inspect(x.req.block_no)[i]);
+    }
+    assert_eq(num_commands, 2);
+}
+
+void test_fifo() {
+    initialize_sched(IOSCHED_FIFO);
+
+    Request r[4];
+    r[0].submit(100, false);
+    r[1].submit(10, false);
+    r[2].submit(12, false);
+    r[3].submit(11, false);
+
+    usize order[] = {10, 12, 11};
+    for (usize block_no : order) {
+        step();
+        assert_eq(inflight_size, 1);
+        assert_eq(inflight[0]->block_no, block_no);
+    }
+    step();
+    assert_eq(num_commands, 4);
+}
+
+void test_read_priority() {
+    initialize_sched(IOSCHED_ELEVATOR);
+
+    Request r[4];
+    r[0].submit(100, true);
+    r[1].submit(5, true);
+    r[2].submit(6, true);
+    r[3].submit(500, false);
+
+    step();
+    assert_eq(inflight[0]->write, false);
+    assert_eq(inflight[0]->block_no, 500);
+    step();
+    assert_eq(inflight_size, 2);
+    assert_eq(inflight[0]->block_no, 5);
+}
+
+void test_write_starvation() {
+    initialize_sched(IOSCHED_ELEVATOR);
+
+    constexpr usize num_reads = 4 * IOSCHED_READ_BATCHES;
+    Request w[2], r[num_reads];
+    w[0].submit(1000, true);
+    w[1].submit(7, true);
+    for (usize i = 0; i < num_reads; i++)
+        r[i].submit(100 + 2 * i, false);
+
+    usize batches = 0;
+    while (step() && inflight && !inflight[0]->write)
+        batches++;
+    assert_eq(batches, IOSCHED_READ_BATCHES);
+    assert_eq(inflight[0]->block_no, 7);
+    while (step())
+        ;
+}
+
+}  // namespace basic
+
+namespace bench {
+
+// a command costs as much as a seek over this many blocks.
+constexpr usize COMMAND_COST = 64;
+
+// readers scan their own files while write-back writes random blocks. the
+// device completes two batches per round, so requests queue up.
+usize simulate(IOSchedPolicy policy) {
+    initialize_sched(policy);
+
+    constexpr usize num_readers = 4, num_writes = 2, num_rounds = 256;
+    std::vector<Request> reqs(num_rounds * (num_readers + num_writes));
+    std::mt19937 gen(0x19260817);
+    usize k = 0;
+    for (usize round = 0; round < num_rounds; round++) {
+        for (usize i = 0; i < num_readers; i++)
+            reqs[k++].submit(100 + i * 800 + round, false);
+        for (usize i = 0; i < num_writes; i++)
+            reqs[k++].submit(3300 + gen() % 800, true);
+        step();
+        step();
+    }
+    while (step())
+        ;
+
+    for (auto& x : reqs) {
+        assert_eq(get_sem(&x.req.done), true);
+        if (!x.req.write) {
+            for (usize i = 0; i < BLOCK_SIZE; i++)
+                assert_eq(x.buffer[i], mock.inspect(x.req.block_no)[i]);
+        }
+    }
+    assert_eq(mock.write_count, num_rounds * num_writes);
+
+    usize cost = num_commands * COMMAND_COST + mock.seek_distance;
+    printf("(debug) %s: %zu requests, %zu commands, seek %zu, cost %zu\n",
+           policy == IOSCHED_FIFO ? "fifo" : "elevator", reqs.size(), num_commands,
+           (usize)mock.seek_distance, cost);
+    return cost;
+}
+
+void test_policies() {
+    usize fifo = simulate(IOSCHED_FIFO);
+    usize elevator = simulate(IOSCHED_ELEVATOR);
+    assert_true(elevator < fifo);
+}
+
+}  // namespace bench
+
+int main() {
+    std::vector<Testcase> tests = {
+        {"merge", basic::test_merge},
+        {"fifo", basic::test_fifo},
+        {"read_priority", basic::test_read_priority},
+        {"write_starvation", basic::test_write_starvation},
+
+        {"policies_bench", bench::test_policies},
+    };
+    Runner(tests).run();
+
+    printf("(info) OK: %zu tests passed.\n", tests.size());
+
+    return 0;
+}
@@ -39,6 +39,11 @@ struct MockBlockDevice {
     std::atomic<usize> write_count;
     std::vector<Block> disk;
 
+    // a seek-cost model: the disk head is after the last accessed block,
+    // and an access costs the distance it moves.
+    std::atomic<usize> position;
+    std::atomic<usize> seek_distance;
+
     using Hook = std::function<void(usize block_no, u8 *buffer)>;
 
     Hook on_read;
@@ -50,6 +55,8 @@ struct MockBlockDevice {
         offline = false;
         read_count = 0;
         write_count = 0;
+        position = 0;
+        seek_distance = 0;
         {
             std::vector<Block> new_disk(sblock->num_blocks);
             std::swap(disk, new_disk);
@@ -129,11 +136,17 @@ struct MockBlockDevice {
             throw Offline("disk power failure");
     }
 
+    void seek(usize block_no) {
+        usize from = position.exchange(block_no + 1);
+        seek_distance += from > block_no ? from - block_no : block_no - from;
+    }
+
     void read(usize block_no, u8 *buffer) {
         if (block_no >= disk.size())
             throw AssertionFailure("block number is out of range");
 
         check_offline();
+        seek(block_no);
 
         auto &block = disk[block_no];
         std::scoped_lock lock(block.mutex);
@@ -157,6 +170,7 @@ struct MockBlockDevice {
             throw AssertionFailure("block number is out of range");
 
         check_offline();
+        seek(block_no);
 
         auto &block = disk[block_no];
         std::scoped_lock lock(block.mutex);
@@ -14,6 +14,30 @@ static void stub_write(usize block_no, u8 *buffer) {
     mock.write(block_no, buffer);
 }
 
+static void stub_read_blocks(usize start, usize count, u8 *buffer) {
+    for (usize i = 0; i < count; i++) {
+        mock.read(start + i, buffer + i * BLOCK_SIZE);
+    }
+}
+
+static void stub_write_blocks(usize start, usize count, u8 *buffer) {
+    for (usize i = 0; i < count; i++) {
+        mock.write(start + i, buffer + i * BLOCK_SIZE);
+    }
+}
+
+// the transfer is done at once, and completes before returning.
+static void stub_submit(IORequest *req) {
+    for (usize i = 0; i < req->count; i++) {
+        if (req->write)
+            mock.write(req->block_no + i, req->buffer + i * BLOCK_SIZE);
+        else
+            mock.read(req->block_no + i, req->buffer + i * BLOCK_SIZE);
+    }
+    init_sem(&req->done, 0);
+    iosched_complete(req);
+}
+
 static void initialize_mock(  //
     usize log_size,
     usize num_data_blocks,
@@ -31,6 +55,9 @@ static void initialize_mock(  //
 
     device.read = stub_read;
     device.write = stub_write;
+    device.read_blocks = stub_read_blocks;
+    device.write_blocks = stub_write_blocks;
+    device.submit = stub_submit;
 
     if (!image_path.empty())
         mock.load(image_path);
@@ -13,7 +13,8 @@ extern "C" {
 #include "../exception.hpp"
 
 struct MockBlockCache {
-    static constexpr usize num_blocks = 2000;
+    // large enough for a file mapped through the double indirect block.
+    static constexpr usize num_blocks = 10000;
     static constexpr usize inode_start = 200;
     static constexpr usize block_start = 1000;
     static constexpr usize num_inodes = 1000;
@@ -73,6 +74,11 @@ struct MockBlockCache {
     std::mutex mutex;
     std::condition_variable cv;
     std::atomic<usize> oracle, top_oracle;
+    std::atomic<usize> acquire_count = 0;
+    std::atomic<usize> sync_count = 0;
+    // bitmap updates and blocks zeroed by `alloc`, which a real cache writes
+    // like synced blocks.
+    std::atomic<usize> bitmap_count = 0, zero_count = 0;
     std::unordered_map<usize, bool> scoreboard;
 
     // mbit: bitmap cached in memory, which is volatile
@@ -117,6 +123,7 @@ struct MockBlockCache {
                 node[i].addrs[j] = gen();
             }
             node[i].indirect = gen();
+            node[i].double_indirect = gen();
         }
 
         // mock root inode.
@@ -129,6 +136,7 @@ struct MockBlockCache {
             node[1].addrs[i] = 0;
         }
         node[1].indirect = 0;
+        node[1].double_indirect = 0;
 
         usize step = 0;
         for (usize i = 0, j = inode_start; i < num_inodes; i += step, j++) {
@@ -288,6 +296,8 @@ struct MockBlockCache {
                 if (!ctx)
                     store(mblk[i], sblk[i]);
 
+                bitmap_count++;
+                zero_count++;
                 return i;
             }
         }
@@ -295,6 +305,35 @@ struct MockBlockCache {
         throw AssertionFailure("no free block");
     }
 
+    // like `alloc`, but take up to `*count` free blocks in a row, and leave
+    // the junk in them.
+    auto alloc_run(OpContext *ctx, usize *count) -> usize {
+        for (usize i = block_start; i < num_blocks; i++) {
+            std::scoped_lock guard(mbit[i].mutex, sbit[i].mutex);
+            load(mbit[i], sbit[i]);
+            if (mbit[i].used)
+                continue;
+
+            usize n = 0;
+            while (true) {
+                mbit[i + n].used = true;
+                if (!ctx)
+                    store(mbit[i + n], sbit[i + n]);
+                if (++n == *count || i + n == num_blocks)
+                    break;
+                std::scoped_lock next(mbit[i + n].mutex, sbit[i + n].mutex);
+                load(mbit[i + n], sbit[i + n]);
+                if (mbit[i + n].used)
+                    break;
+            }
+            *count = n;
+            bitmap_count++;
+            return i;
+        }
+
+        throw AssertionFailure("no free block");
+    }
+
     void free(OpContext *ctx, usize i) {
         check_block_no(i);
 
@@ -310,6 +349,7 @@ struct MockBlockCache {
 
     auto acquire(usize i) -> Block * {
         check_block_no(i);
+        acquire_count++;
 
         mblk[i].mutex.lock();
 
@@ -329,6 +369,7 @@ struct MockBlockCache {
     void sync(OpContext *ctx, Block *b) {
         auto *p = check_and_get_cell(b);
         usize i = p->index;
+        sync_count++;
 
         if (!ctx) {
             std::scoped_lock guard(sblk[i].mutex);
@@ -18,6 +18,15 @@ static usize stub_alloc(OpContext *ctx) {
     return mock.alloc(ctx);
 }
 
+// the mock does not care about the layout.
+static usize stub_alloc_near(OpContext *ctx, usize) {
+    return mock.alloc(ctx);
+}
+
+static usize stub_alloc_run(OpContext *ctx, usize, usize *count) {
+    return mock.alloc_run(ctx, count);
+}
+
 static void stub_free(OpContext *ctx, usize block_no) {
     mock.free(ctx, block_no);
 }
@@ -41,8 +50,11 @@ static struct _Loader {
         cache.begin_op = stub_begin_op;
         cache.end_op = stub_end_op;
         cache.alloc = stub_alloc;
+        cache.alloc_near = stub_alloc_near;
+        cache.alloc_run = stub_alloc_run;
         cache.free = stub_free;
         cache.acquire = stub_acquire;
+        cache.acquire_new = stub_acquire;
         cache.release = stub_release;
         cache.sync = stub_sync;
     }
@@ -7,6 +7,7 @@
 #include <time.h>
 #include <cassert>
 #include <map>
+#include <algorithm>
 #include <unistd.h>
 namespace {
 
@@ -64,6 +65,10 @@ void init_spinlock(struct SpinLock* lock, const char* name [[maybe_unused]]) {
     mtx_map.try_add(lock);
 }
 
+void init_named_spinlock(struct SpinLock* lock, const char* name [[maybe_unused]]) {
+    mtx_map.try_add(lock);
+}
+
 void _acquire_spinlock(struct SpinLock* lock) {
     if (holding++ == 0)
         blocker.p();
@@ -149,6 +154,16 @@ int get_all_sem(Semaphore* x)
     _unlock_sem(x);
     return ret;
 }
+int _wake_sem(Semaphore* x, int n)
+{
+    int ret = 0;
+    if (sa(x) > sb(x))
+    {
+        ret = std::min((uint64_t)n, sa(x) - sb(x));
+        sb(x) += ret;
+    }
+    return ret;
+}
 int post_all_sem(Semaphore* x)
 {
     int ret = 0;
@@ -69,14 +69,13 @@ isize console_read(Inode *ip, char *dst, isize n) {
                 return -1;
             }
 
-            //sleep 获取所有信号量
-            get_all_sem(&input.rlock);
+            //sleep，console_intr在input.lock下唤醒一个读者
             _lock_sem(&input.rlock);
             _release_spinlock(&input.lock);
             bool ret = _wait_sem(&input.rlock, false);
             ASSERT(ret || true);
 
-            // _acquire_spinlock(&input.lock);
+            _acquire_spinlock(&input.lock);
         }
         c = input.buf[input.r++ % INPUT_BUF];
         if (c == C('D')) {
@@ -91,6 +90,10 @@ isize console_read(Inode *ip, char *dst, isize n) {
             break;
         }  
     }
+    //还有已提交的输入，让下一个读者继续
+    if (input.r != input.w) {
+        wake_sem(&input.rlock, 1);
+    }
     
     _release_spinlock(&input.lock);
 
@@ -147,7 +150,7 @@ void console_intr(char (*getc)()) {
 
                     if (c == '\n' || c == C('D') || input.e - input.r == INPUT_BUF) {
                         input.w = input.e;
-                        post_all_sem(&input.rlock);
+                        wake_sem(&input.rlock, 1);
                     }
                 }
                 break;
@@ -8,6 +8,7 @@
 #include <kernel/pid.h>
 
 struct container root_container;
+static u64 root_localpids[PIDMAP_WORDS];
 extern struct proc root_proc;
 
 void activate_group(struct container* group);
@@ -24,13 +25,7 @@ void init_container(struct container* container)
     container->rootproc = NULL;
     init_schinfo(&container->schinfo, true);
     init_schqueue(&container->schqueue);
-    // TODO: initialize namespace (local pid allocator)
-
-    init_spinlock(&container->localpidmap.pidlock);
-    _acquire_spinlock(&container->localpidmap.pidlock);
-    container->localpidmap.free_num = PID_MAX;
-    memset(container->localpidmap.map, 0, MAP_SIZE);
-    _release_spinlock(&container->localpidmap.pidlock);
+    // the local pid allocator is set up by the caller, see init_pidmap
 }
 
 struct container* create_container(void (*root_entry)(), u64 arg)
@@ -38,6 +33,7 @@ struct container* create_container(void (*root_entry)(), u64 arg)
     // TODO
     struct container* container = kalloc(sizeof(struct container));
     init_container(container);
+    init_pidmap(&container->localpidmap, kalloc_page());
     container->parent = thisproc()->container;
     struct proc* rootproc = create_proc();
     set_parent_to_this(rootproc);
@@ -53,5 +49,6 @@ struct container* create_container(void (*root_entry)(), u64 arg)
 define_early_init(root_container)
 {
     init_container(&root_container);
+    init_pidmap(&root_container.localpidmap, root_localpids);
     root_container.rootproc = &root_proc;
 }
@@ -29,12 +29,12 @@ NO_RETURN void idle_entry() {
 static void create_user_proc() {
     auto p = create_proc();
     for (u64 q = (u64)icode; q < (u64)eicode; q += PAGE_SIZE) {
-        vmmap(&p->pgdir, 0x400000 + q - (u64)icode, (void*)q, PTE_USER_DATA);
+        vmmap(p->pgdir, 0x400000 + q - (u64)icode, (void*)q, PTE_USER_DATA);
     }
-    struct section* section = create_section(&p->pgdir.section_head, ST_TEXT);
+    struct section* section = create_section(&p->pgdir->section_head, ST_TEXT);
     section->begin = PAGE_BASE((u64)icode);
     section->end = PAGE_UP((u64)eicode);
-    ASSERT(p->pgdir.pt);
+    ASSERT(p->pgdir->pt);
     p->ucontext->x[0] = 0;
     p->ucontext->elr = 0x400000;
     p->ucontext->spsr = 0;
@@ -31,42 +31,74 @@ static void __timer_set_clock()
     if (t1 <= t0)
         reset_clock(0);
     else
-        reset_clock(t1 - t0);
+        reset_clock(MIN(t1 - t0, (u64)1000)); // the clock handler rearms it anyway
 }
 
 static void timer_clock_handler() {
+    struct cpu* c;
     reset_clock(1000);
     while (1)
     {
-        auto node = _rb_first(&cpus[cpuid()].timer);
+        // a handler may yield, so we can come back on another cpu
+        c = &cpus[cpuid()];
+        _acquire_spinlock(&c->timerlock);
+        auto node = _rb_first(&c->timer);
         if (!node)
             break;
         auto timer = container_of(node, struct timer, _node);
         if (get_timestamp_ms() < timer->_key)
             break;
-        cancel_cpu_timer(timer);
+        _rb_erase(&timer->_node, &c->timer);
         timer->triggered = true;
+        // the handler may rearm timers or even yield, so call it without the lock
+        _release_spinlock(&c->timerlock);
         timer->handler(timer);
     }
+    __timer_set_clock();
+    _release_spinlock(&c->timerlock);
 }
 
 define_early_init(clock_handler) {
+    for (int i = 0; i < NCPU; i++)
+        init_spinlock(&cpus[i].timerlock);
     set_clock_handler(&timer_clock_handler);
 }
 
 void set_cpu_timer(struct timer* timer)
 {
+    auto c = &cpus[cpuid()];
+    _acquire_spinlock(&c->timerlock);
     timer->triggered = false;
+    timer->_cpu = cpuid();
     timer->_key = get_timestamp_ms() + timer->elapse;
-    ASSERT(0 == _rb_insert(&timer->_node, &cpus[cpuid()].timer, __timer_cmp));
+    ASSERT(0 == _rb_insert(&timer->_node, &c->timer, __timer_cmp));
     __timer_set_clock();
+    _release_spinlock(&c->timerlock);
+}
+
+// a timer always fires on the cpu where it is set, but it may be cancelled
+// from another cpu (e.g. by a process that has migrated since then).
+bool try_cancel_cpu_timer(struct timer* timer)
+{
+    auto c = &cpus[timer->_cpu];
+    bool ret = false;
+    _acquire_spinlock(&c->timerlock);
+    if (!timer->triggered)
+    {
+        _rb_erase(&timer->_node, &c->timer);
+        timer->triggered = true;
+        ret = true;
+        if (timer->_cpu == cpuid())
+            __timer_set_clock();
+    }
+    _release_spinlock(&c->timerlock);
+    return ret;
 }
 
 void cancel_cpu_timer(struct timer* timer)
 {
     ASSERT(!timer->triggered);
-    _rb_erase(&timer->_node, &cpus[cpuid()].timer);
-    __timer_set_clock();
+    ASSERT(try_cancel_cpu_timer(timer));
 }
 
 static struct timer hello_timer[4];
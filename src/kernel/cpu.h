@@ -13,11 +13,13 @@ struct timer
     struct rb_node_ _node;
     void (*handler)(struct timer*);
     u64 data;
+    int _cpu;
 };
 
 struct cpu
 {
     bool online;
+    SpinLock timerlock;
     struct rb_root_ timer;
     struct sched sched;
 };
@@ -29,3 +31,4 @@ void set_cpu_off();
 
 void set_cpu_timer(struct timer* timer);
 void cancel_cpu_timer(struct timer* timer);
+WARN_RESULT bool try_cancel_cpu_timer(struct timer* timer);
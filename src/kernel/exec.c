@@ -12,6 +12,7 @@
 #include <aarch64/trap.h>
 #include <fs/file.h>
 #include <fs/inode.h>
+#include <fs/readahead.h>
 
 #define MAXARG 32
 #define STACK_BASE 0x60000000 
@@ -41,6 +42,12 @@ int execve(const char *path, char *const argv[], char *const envp[]) {
 
 	ASSERT((u64)envp || true);
 
+	// the other threads would have to be killed from under the leader
+	if (p->leader != p) {
+		printk("execve: exec from a non-leader thread is not supported\n");
+		return -1;
+	}
+
 	bcache.begin_op(ctx);
 
 	//步骤1:从存储在' path '中的文件中加载数据
@@ -64,8 +71,8 @@ int execve(const char *path, char *const argv[], char *const envp[]) {
 	}
 
 	//重置section
-	// free_sections(&p->pgdir);
-	// create_file_sections(&p->pgdir.section_head);
+	// free_sections(p->pgdir);
+	// create_file_sections(p->pgdir->section_head);
 
 	init_pgdir(&pd);
 	create_file_sections(&pd.section_head);
@@ -166,18 +173,22 @@ int execve(const char *path, char *const argv[], char *const envp[]) {
 	// }
 	// *(u64*)sp = argc;
 	
-	free_pgdir(&p->pgdir);
-	init_pgdir(&p->pgdir);
-	copy_pgdir(&pd, &p->pgdir);
+	// the other threads would run on in an image that is gone
+	kill_threads();
+	struct pgdir* old_pgdir = p->pgdir;
+	p->pgdir = create_pgdir();
+	copy_pgdir(&pd, p->pgdir);
 
 	free_pgdir(&pd);
 
     p->ucontext->elr = elf.e_entry;
     p->ucontext->sp_el0 = sp;  
 
-    attach_pgdir(&p->pgdir);
+    attach_pgdir(p->pgdir);
+    put_pgdir(old_pgdir);
     arch_fence();
     arch_tlbi_vmalle1is();
+    release_vfork_parent(p);
 
 	// printk("exec end\n");
    
@@ -226,6 +237,8 @@ static int load_seg(struct pgdir *pd, u64 va, Inode *ip, usize offset, usize sz,
 
 	u64 pte_flags = PTE_USER_DATA;
 	pte_flags = (flags & ST_RO) ? (pte_flags | PTE_RO) : (pte_flags | PTE_RW);
+	// the whole segment is read page by page, fetch its blocks in the background.
+	readahead(ip, offset, sz);
 	while (p < end) {
 		file_off = (p < va) ? 0 : (p - va);
 		page_off = (p < va) ? (va - p) : 0;
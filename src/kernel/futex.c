@@ -0,0 +1,144 @@
+#include <kernel/futex.h>
+#include <kernel/syscall.h>
+#include <kernel/proc.h>
+#include <kernel/sched.h>
+#include <kernel/printk.h>
+#include <kernel/paging.h>
+#include <kernel/mem.h>
+#include <kernel/init.h>
+#include <common/sem.h>
+#include <errno.h>
+#include <time.h>
+
+#define FUTEX_HASH_SIZE 64
+
+// Private futexes are keyed on (pgdir, va). Futexes in shared mappings are
+// keyed on the physical address, since every process maps them differently.
+typedef struct {
+    struct pgdir* pd; // NULL for shared futexes
+    u64 addr;
+} FutexKey;
+
+// one queue per contended futex word, freed when its last waiter leaves.
+typedef struct {
+    FutexKey key;
+    int ref;
+    Semaphore sem;
+    ListNode node;
+} FutexQueue;
+
+static struct {
+    SpinLock lock;
+    ListNode head;
+} futex_table[FUTEX_HASH_SIZE];
+
+define_early_init(futex) {
+    for (int i = 0; i < FUTEX_HASH_SIZE; i++) {
+        init_spinlock(&futex_table[i].lock);
+        init_list_node(&futex_table[i].head);
+    }
+}
+
+static FutexKey futex_key(int* uaddr) {
+    FutexKey key;
+    struct pgdir* pd = thisproc()->pgdir;
+    auto st = lookup_section(pd, (u64)uaddr);
+    if (st && (st->flags & ST_SHARED)) {
+        key.pd = NULL;
+        key.addr = PTE_ADDRESS(*get_pte(pd, (u64)uaddr, false)) + (u64)uaddr % PAGE_SIZE;
+    } else {
+        key.pd = pd;
+        key.addr = (u64)uaddr;
+    }
+    return key;
+}
+
+static INLINE int futex_hash(FutexKey key) {
+    u64 h = (key.addr >> 2) ^ ((u64)key.pd >> 6);
+    return (h ^ (h >> 16)) % FUTEX_HASH_SIZE;
+}
+
+static FutexQueue* lookup_queue(ListNode* head, FutexKey key) {
+    _for_in_list(node, head) {
+        if (node == head)
+            continue;
+        auto q = container_of(node, FutexQueue, node);
+        if (q->key.pd == key.pd && q->key.addr == key.addr)
+            return q;
+    }
+    return NULL;
+}
+
+int futex_wait(int* uaddr, int val, i64 timeout_ms) {
+    if ((u64)uaddr % sizeof(int) || !user_readable(uaddr, sizeof(int)))
+        return -1;
+    auto key = futex_key(uaddr);
+    auto b = &futex_table[futex_hash(key)];
+    _acquire_spinlock(&b->lock);
+    // futex_wake takes the bucket lock too, so no wakeup is lost between
+    // the check and the sleep.
+    if (*(volatile int*)uaddr != val) {
+        _release_spinlock(&b->lock);
+        return -1;
+    }
+    auto q = lookup_queue(&b->head, key);
+    if (!q) {
+        q = kalloc(sizeof(FutexQueue));
+        q->key = key;
+        q->ref = 0;
+        init_sem(&q->sem, 0);
+        _insert_into_list(&b->head, &q->node);
+    }
+    q->ref++;
+    _lock_sem(&q->sem);
+    _release_spinlock(&b->lock);
+    int ret;
+    if (timeout_ms < 0)
+        ret = _wait_sem(&q->sem, true) ? 1 : -1;
+    else
+        ret = _wait_sem_timeout(&q->sem, true, timeout_ms);
+    _acquire_spinlock(&b->lock);
+    if (--q->ref == 0) {
+        _detach_from_list(&q->node);
+        kfree(q);
+    }
+    _release_spinlock(&b->lock);
+    return ret == 1 ? 0 : -1;
+}
+
+int futex_wake(int* uaddr, int n) {
+    if ((u64)uaddr % sizeof(int) || !user_readable(uaddr, sizeof(int)))
+        return -1;
+    auto key = futex_key(uaddr);
+    auto b = &futex_table[futex_hash(key)];
+    int woken = 0;
+    _acquire_spinlock(&b->lock);
+    auto q = lookup_queue(&b->head, key);
+    if (q) {
+        woken = wake_sem(&q->sem, n);
+    }
+    _release_spinlock(&b->lock);
+    return woken;
+}
+
+define_syscall(futex, int* uaddr, int op, int val, const struct timespec* timeout, int* uaddr2, int val3) {
+    (void)uaddr2, (void)val3;
+    switch (op & ~(FUTEX_PRIVATE_FLAG | FUTEX_CLOCK_REALTIME)) {
+    case FUTEX_WAIT: {
+        i64 ms = -1;
+        if (timeout) {
+            if (!user_readable(timeout, sizeof(struct timespec)))
+                return -1;
+            if (timeout->tv_sec < 0 || timeout->tv_nsec < 0 || timeout->tv_nsec >= 1000000000)
+                return -EINVAL;
+            ms = timeout->tv_sec * 1000 + (timeout->tv_nsec + 999999) / 1000000;
+        }
+        return futex_wait(uaddr, val, ms);
+    }
+    case FUTEX_WAKE:
+        return futex_wake(uaddr, val);
+    default:
+        printk("sys_futex: unsupported op %d\n", op);
+        return -1;
+    }
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <common/defines.h>
+
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+#define FUTEX_PRIVATE_FLAG 128
+#define FUTEX_CLOCK_REALTIME 256
+
+// block if *uaddr == val until woken up or timeout_ms (-1 for no timeout) passes.
+// return 0 if woken up by futex_wake, -1 otherwise.
+int futex_wait(int* uaddr, int val, i64 timeout_ms);
+// wake up at most n waiters on uaddr. return the number of woken waiters.
+int futex_wake(int* uaddr, int n);
@@ -29,6 +29,7 @@ struct page pages_info[PAGE_NUM];
 kmem_cache_t caches[SLAB_MAX + 1]; //4~11
 
 define_early_init(pages) {   
+    init_named_spinlock(&mem_lock, "mem_lock");
     init_spinlock(&left_page_lk);
     left_page_num = 0;
 
@@ -192,32 +193,12 @@ u32 write_page_to_disk(void* ka) {
     // printk("----\n");
     u32 bno = find_and_set_8_blocks();
     // printk("%d\n", bno);
-    // OpContext ctx;
-    // bcache.begin_op(&ctx);
-    for (usize i = 0; i < BLOCKS_PER_PAGE; i++) {
-        // printk("----\n");
-        Block* b = bcache.acquire(bno + i);
-        memcpy(b->data, (u8*)ka + i*BLOCK_SIZE, BLOCK_SIZE);
-        // printk("--b->data--:%lld\n", *(i64*)b->data);
-        bcache.sync(NULL, b);
-        bcache.release(b);
-    }
-    // bcache.end_op(&ctx);
+    // swap blocks are never cached, so the page goes to disk in one transfer.
+    block_device.write_blocks(bno, BLOCKS_PER_PAGE, ka);
     return bno;
 }
 
 void read_page_from_disk(void* ka, u32 bno) {
-    // OpContext ctx;
-    // bcache.begin_op(&ctx);
-    
-    for (usize i = 0; i < BLOCKS_PER_PAGE; i++) {
-        Block* b = bcache.acquire(bno + i);
-        memcpy((u8*)ka + i*BLOCK_SIZE, b->data, BLOCK_SIZE);
-        // printk("b->data:%lld\n", *(i64*)b->data);
-        // bcache.sync(&ctx, b);
-        bcache.release(b);
-    }
-    // bcache.end_op(&ctx);
-
+    block_device.read_blocks(bno, BLOCKS_PER_PAGE, ka);
     release_8_blocks(bno);
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include <aarch64/mmu.h>
 #include <fs/block_device.h>
 #include <fs/cache.h> 
+#include <fs/inode.h>
 #include <kernel/paging.h>
 #include <common/defines.h>
 #include <kernel/pt.h>
@@ -15,13 +16,18 @@
 #include <kernel/proc.h>
 #include <kernel/cpu.h>
 
+// blocks evicted from the block cache per round of reclaim
+#define BCACHE_RECLAIM_BATCH 64
+// unreferenced inodes freed per round of reclaim
+#define INODE_RECLAIM_BATCH 64
+
 define_rest_init(paging){
 	//TODO init		
 }
 
 u64 sbrk(i64 size){
 	//TODO
-	struct section* heap_section = get_heap(&thisproc()->pgdir);
+	struct section* heap_section = get_heap(thisproc()->pgdir);
 	u64 origin_end = heap_section->end;
 	if (size >= 0) {
 		heap_section->end += size*PAGE_SIZE;
@@ -32,7 +38,7 @@ u64 sbrk(i64 size){
 		// printk("-size:%lld\n", heap_section->end);
 		if (heap_section->flags & ST_SWAP) {
 			for (u64 va = heap_section->end; va < heap_section->end-size*PAGE_SIZE; va+=PAGE_SIZE) {
-				PTEntriesPtr pte = get_pte(&thisproc()->pgdir, va, false);
+				PTEntriesPtr pte = get_pte(thisproc()->pgdir, va, false);
 				if (pte == NULL) continue;
 				if (*pte == 0) continue;
 
@@ -44,7 +50,7 @@ u64 sbrk(i64 size){
 		}
 		else {
 			for (u64 va = heap_section->end; va < heap_section->end-size*PAGE_SIZE; va+=PAGE_SIZE) {
-				PTEntriesPtr pte = get_pte(&thisproc()->pgdir, va, false);
+				PTEntriesPtr pte = get_pte(thisproc()->pgdir, va, false);
 				if (pte == NULL) continue;
 				if (*pte == 0) continue;
 				
@@ -123,17 +129,58 @@ struct section* get_heap(struct pgdir* pd) {
 	return heap_section;
 }
 
+struct section* lookup_section(struct pgdir* pd, u64 va) {
+	_for_in_list(section_node, &pd->section_head) {
+		if (section_node == &pd->section_head)	continue;
+		struct section* section = container_of(section_node, struct section, stnode);
+		if (section->begin <= va && va < section->end)
+			return section;
+	}
+	return NULL;
+}
+
+// map len bytes of zeroed anonymous memory above MMAP_BASE, all of it up
+// front. pages of a shared mapping are not copied by fork.
+u64 mmap_anonymous(struct pgdir* pd, u64 len, bool shared, bool writable) {
+	u64 begin = MMAP_BASE;
+	_for_in_list(section_node, &pd->section_head) {
+		if (section_node == &pd->section_head)	continue;
+		struct section* section = container_of(section_node, struct section, stnode);
+		if ((section->flags & ST_MMAP) && section->end > begin)
+			begin = section->end;
+	}
+	u64 end = begin + PAGE_UP(len);
+	if (len == 0 || end > MMAP_TOP)
+		return (u64)-1;
+	struct section* section = create_section(&pd->section_head, ST_MMAP | (shared ? ST_SHARED : 0) | (writable ? 0 : ST_RO));
+	section->begin = begin;
+	section->end = end;
+	for (u64 va = begin; va < end; va += PAGE_SIZE) {
+		void* ka = alloc_page_for_user();
+		memset(ka, 0, PAGE_SIZE);
+		vmmap(pd, va, ka, PTE_USER_DATA | (writable ? PTE_RW : PTE_RO));
+	}
+	arch_tlbi_vmalle1is();
+	return begin;
+}
+
 void* alloc_page_for_user(){
 	while (left_page_cnt() <= REVERSED_PAGES){ //this is a soft limit
+		// cached blocks are the cheapest memory to give back
+		if (reclaim_bcache(BCACHE_RECLAIM_BATCH) > 0)
+			continue;
+		// then the inodes nobody refers to
+		if (reclaim_inodes(INODE_RECLAIM_BATCH) > 0)
+			continue;
 		//TODO
 		// struct proc* swap_proc = get_offline_proc();
-		// struct section* heap_section = get_heap(&swap_proc->pgdir);
-		// if (swap_proc->pgdir.online || (heap_section->flags & ST_SWAP)) {
-		// 	_release_spinlock(&swap_proc->pgdir.lock);
+		// struct section* heap_section = get_heap(swap_proc->pgdir);
+		// if (swap_proc->pgdir->online || (heap_section->flags & ST_SWAP)) {
+		// 	_release_spinlock(&swap_proc->pgdir->lock);
 		// 	break;
 		// }
 		// else {
-		// 	swapout(&swap_proc->pgdir, heap_section);
+		// 	swapout(swap_proc->pgdir, heap_section);
 		// 	break;
 		// }
 		break;
@@ -201,7 +248,7 @@ void swapin(struct pgdir* pd, struct section* st){
 int pgfault(u64 iss){
 	// printk("ISS: %llx\n", iss);
 	struct proc* p = thisproc();
-	struct pgdir* pd = &p->pgdir;
+	struct pgdir* pd = p->pgdir;
 	u64 addr = arch_get_far();
 	printk("addr: %llx\n", addr);
 	//TODO
@@ -7,10 +7,16 @@
 #define ST_SWAP  (1<<1)
 #define ST_RO    (1<<2)
 #define ST_HEAP  (1<<3)
+#define ST_SHARED (1<<4) // anonymous pages shared with children
+#define ST_MMAP  (1<<5)
 #define ST_TEXT  (ST_FILE | ST_RO)
 #define ST_DATA   ST_FILE 
 #define ST_BSS    ST_FILE	
 
+// anonymous mappings live between the program and the user stack
+#define MMAP_BASE 0x40000000
+#define MMAP_TOP  0x60000000
+
 struct section{
     u64 flags;
     SleepLock sleeplock;
@@ -31,3 +37,5 @@ void create_file_sections(ListNode* section_head);
 void free_sections(struct pgdir* pd);
 u64 sbrk(i64 size);
 struct section* get_heap(struct pgdir* pd);
+struct section* lookup_section(struct pgdir* pd, u64 va);
+u64 mmap_anonymous(struct pgdir* pd, u64 len, bool shared, bool writable);
@@ -3,46 +3,93 @@
 #include <common/string.h>
 #include <kernel/printk.h>
 
+static struct {
+    PidLink* head[PID_HASH_SIZE];
+    SpinLock lock;
+} pidhash;
+
+static ALWAYS_INLINE PidLink** pid_bucket(pidmap_t* pidmap, int pid) {
+    return &pidhash.head[(pid ^ ((u64)pidmap >> 6)) % PID_HASH_SIZE];
+}
+
+void init_pidmap(pidmap_t* pidmap, u64* map) {
+    memset(map, 0, PIDMAP_WORDS * sizeof(u64));
+    // pid 0 is never handed out
+    map[0] = 1;
+    pidmap->map = map;
+    pidmap->free_num = PID_MAX - 1;
+    pidmap->next = 1;
+}
+
 int alloc_pid(pidmap_t* pidmap) {
-    _acquire_spinlock(&pidmap->pidlock);
-    if (!pidmap->free_num) {
-        _release_spinlock(&pidmap->pidlock);
-        return -1;
-    }
-    int pid_ = 1;
-    int *p; int mask;
-    while (pid_ < PID_MAX) {
-        p = ((int*)(&pidmap->map)) + (pid_ >> 5);
-        mask = 1 << (pid_ & 31);
-        if (~(*p) & mask) {
-            *p = *p | mask; break;
+    int start = __atomic_load_n(&pidmap->next, __ATOMIC_RELAXED);
+    // one more word than the map to wrap around to the bits below the cursor
+    for (int i = 0; i <= PIDMAP_WORDS; i++) {
+        int w = ((start >> 6) + i) % PIDMAP_WORDS;
+        u64 mask = i == 0 ? ~0ull << (start & 63) : ~0ull;
+        u64 word = __atomic_load_n(&pidmap->map[w], __ATOMIC_RELAXED);
+        while (~word & mask) {
+            int bit = __builtin_ctzll(~word & mask);
+            // on failure word is reloaded and the search goes on
+            if (__atomic_compare_exchange_n(&pidmap->map[w], &word, word | (1ull << bit),
+                                            true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                int pid = w * 64 + bit;
+                __atomic_store_n(&pidmap->next, (pid + 1) % PID_MAX, __ATOMIC_RELAXED);
+                __atomic_fetch_sub(&pidmap->free_num, 1, __ATOMIC_RELAXED);
+                return pid;
+            }
         }
-        pid_++;
-    }
-    if (pid_ < PID_MAX) {
-        pidmap->free_num--;
-        _release_spinlock(&pidmap->pidlock);
-        return pid_;
     }
-    _release_spinlock(&pidmap->pidlock);
     return -1;
 }
 
-
 void free_pid(pidmap_t* pidmap, int pid) {
-    _acquire_spinlock(&pidmap->pidlock);
-    int *p = ((int*)(&pidmap->map)) + (pid >> 5);
-    int mask = 1 << (pid & 31);
-    *p = *p & ~mask;
-    pidmap->free_num++;
-    _release_spinlock(&pidmap->pidlock);
+    if (pid <= 0 || pid >= PID_MAX)
+        return;
+    __atomic_fetch_and(&pidmap->map[pid >> 6], ~(1ull << (pid & 63)), __ATOMIC_RELEASE);
+    __atomic_fetch_add(&pidmap->free_num, 1, __ATOMIC_RELAXED);
+}
+
+void link_pid(PidLink* link, pidmap_t* pidmap, int pid) {
+    link->map = pidmap;
+    link->pid = pid;
+    _acquire_spinlock(&pidhash.lock);
+    PidLink** head = pid_bucket(pidmap, pid);
+    link->next = *head;
+    if (*head)
+        (*head)->pprev = &link->next;
+    link->pprev = head;
+    *head = link;
+    _release_spinlock(&pidhash.lock);
+}
+
+void unlink_pid(PidLink* link) {
+    _acquire_spinlock(&pidhash.lock);
+    if (link->pprev) {
+        *link->pprev = link->next;
+        if (link->next)
+            link->next->pprev = link->pprev;
+        link->next = NULL;
+        link->pprev = NULL;
+    }
+    _release_spinlock(&pidhash.lock);
+}
+
+PidLink* lookup_pid(pidmap_t* pidmap, int pid) {
+    _acquire_spinlock(&pidhash.lock);
+    PidLink* link = *pid_bucket(pidmap, pid);
+    while (link && (link->map != pidmap || link->pid != pid))
+        link = link->next;
+    _release_spinlock(&pidhash.lock);
+    return link;
+}
+
+define_early_init(pidhash) {
+    init_named_spinlock(&pidhash.lock, "pidhash");
 }
 
-define_init(pidmap) {
-    init_spinlock(&pidmap.pidlock);
+static u64 global_pids[PIDMAP_WORDS];
 
-    _acquire_spinlock(&pidmap.pidlock);
-    pidmap.free_num = PID_MAX;
-    memset(pidmap.map, 0, 512);
-    _release_spinlock(&pidmap.pidlock);
+define_early_init(global_pidmap) {
+    init_pidmap(&pidmap, global_pids);
 }
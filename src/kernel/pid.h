@@ -2,16 +2,34 @@
 
 #include <common/spinlock.h>
 
-#define PID_MAX 0x1000
-#define MAP_SIZE 512
- 
+#define PID_MAX 0x8000
+#define PIDMAP_WORDS (PID_MAX / 64) // exactly one page
+#define PID_HASH_SIZE 1024
+
+// A lock-free pid bitmap. Searching starts from the cursor so that freed
+// pids are not reused right away.
 typedef struct {
-    unsigned int free_num;
-    char map[MAP_SIZE];
-    SpinLock pidlock;
+    u64* map;
+    int free_num;
+    int next; // the cursor, where the next search begins
 } pidmap_t;
 
 pidmap_t pidmap;
 
+// A pid bound to an object, looked up by (pidmap, pid). The global pids and
+// the local pids of every container share one hash table.
+typedef struct PidLink {
+    struct PidLink* next;
+    struct PidLink** pprev;
+    pidmap_t* map;
+    int pid;
+} PidLink;
+
+// map is PIDMAP_WORDS words of storage
+void init_pidmap(pidmap_t* pidmap, u64* map);
 int alloc_pid(pidmap_t* pidmap);
-void free_pid(pidmap_t* pidmap, int pid);
\ No newline at end of file
+void free_pid(pidmap_t* pidmap, int pid);
+void link_pid(PidLink* link, pidmap_t* pidmap, int pid);
+void unlink_pid(PidLink* link);
+// the caller should hold a lock that keeps the found object alive
+WARN_RESULT PidLink* lookup_pid(pidmap_t* pidmap, int pid);
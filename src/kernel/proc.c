@@ -7,6 +7,21 @@
 #include <kernel/printk.h>
 #include <kernel/container.h>
 #include <kernel/paging.h>
+#include <kernel/syscall.h>
+#include <kernel/futex.h>
+#include <kernel/cpu.h>
+#include <aarch64/intrinsic.h>
+
+#define CLONE_VM             0x00000100
+#define CLONE_FS             0x00000200
+#define CLONE_FILES          0x00000400
+#define CLONE_SIGHAND        0x00000800
+#define CLONE_THREAD         0x00010000
+#define CLONE_SYSVSEM        0x00040000
+#define CLONE_SETTLS         0x00080000
+#define CLONE_PARENT_SETTID  0x00100000
+#define CLONE_CHILD_CLEARTID 0x00200000
+#define CLONE_DETACHED       0x00400000
 
 struct proc root_proc;
 extern struct container root_container;
@@ -15,10 +30,24 @@ extern InodeTree inodes;
 void kernel_entry();
 void proc_entry();
 
+#define PROC_CACHE_SIZE 16
+
 static SpinLock plock;
 
+// Freed procs of each cpu, kept with their kstack and an empty pgdir
+// to be handed out again by create_proc.
+static struct {
+    SpinLock lock;
+    ListNode head;
+    int cnt;
+} proc_cache[NCPU];
+
 define_early_init(plock) {
-    init_spinlock(&plock);
+    init_named_spinlock(&plock, "plock");
+    for (int i = 0; i < NCPU; i++) {
+        init_spinlock(&proc_cache[i].lock);
+        init_list_node(&proc_cache[i].head);
+    }
 }
 
 void set_parent_to_this(struct proc* proc)
@@ -33,6 +62,59 @@ void set_parent_to_this(struct proc* proc)
 
 }
 
+static void free_proc(struct proc* p)
+{
+    unlink_pid(&p->localpidlink);
+    unlink_pid(&p->pidlink);
+    free_pid(&p->container->localpidmap, p->localpid);
+    free_pid(&pidmap, p->pid);
+    // exit leaves the emptied pgdir to its last user only
+    if (p->pgdir) {
+        auto cache = &proc_cache[cpuid()];
+        _acquire_spinlock(&cache->lock);
+        if (cache->cnt < PROC_CACHE_SIZE) {
+            _insert_into_list(&cache->head, &p->ptnode);
+            cache->cnt++;
+            _release_spinlock(&cache->lock);
+            return;
+        }
+        _release_spinlock(&cache->lock);
+        free_pgdir(p->pgdir);
+        kfree(p->pgdir);
+    }
+    kfree_page(p->kstack);
+    kfree(p);
+}
+
+// Free the zombie threads of the group. If all is set, kill the other
+// threads and wait until every one of them is freed.
+static void reap_threads(struct proc* leader, bool all)
+{
+    while (1) {
+        bool alive = false;
+        _acquire_spinlock(&plock);
+        ListNode* node = leader->threads.next;
+        while (node != &leader->threads) {
+            auto t = container_of(node, struct proc, thnode);
+            node = node->next;
+            if (is_zombie(t)) {
+                _detach_from_list(&t->thnode);
+                free_proc(t);
+            } else {
+                alive = true;
+                if (all && !t->killed) {
+                    t->killed = true;
+                    alert_proc(t);
+                }
+            }
+        }
+        _release_spinlock(&plock);
+        if (!all || !alive)
+            break;
+        yield();
+    }
+}
+
 NO_RETURN void exit(int code)
 {
     // TODO
@@ -42,12 +124,26 @@ NO_RETURN void exit(int code)
     // 4. notify the parent
     // 5. sched(ZOMBIE)
     // NOTE: be careful of concurrency
-    _acquire_spinlock(&plock);
     auto this = thisproc();
     ASSERT(this != this->container->rootproc && !this->idle);
-    this -> exitcode = code;
+    if (this->leader == this) {
+        // the leader outlives its threads, they are linked to it
+        reap_threads(this, true);
+    } else if (this->clear_tid && user_writeable(this->clear_tid, sizeof(int))) {
+        *this->clear_tid = 0;
+        futex_wake(this->clear_tid, 1);
+    }
+    release_vfork_parent(this);
+    _acquire_spinlock(&plock);
+    // the threads are gone, so the group exit code is final
+    this -> exitcode = this->group_exiting ? this->group_exit_code : code;
 
-    free_pgdir(&(this->pgdir));
+    // other threads may empty the pgdir as soon as it is released, so
+    // leave it first
+    attach_pgdir(NULL);
+    // the last user keeps the emptied pgdir, it is recycled with the proc
+    if (!release_pgdir(this->pgdir))
+        this->pgdir = NULL;
 
     while (!_empty_list(&(this -> children))) {
         ListNode* child_node = (this -> children).next; 
@@ -64,12 +160,7 @@ NO_RETURN void exit(int code)
         }
     }
     
-    for (int fd = 0; fd < NOFILE; fd++) {
-        if (this->oftable.ofile[fd]) {
-            fileclose(this->oftable.ofile[fd]);
-            this->oftable.ofile[fd] = 0;
-        }
-    }
+    put_oftable(this->oftable);
     if (this->cwd) {
         OpContext ctx_, *ctx = &ctx_;
         bcache.begin_op(ctx);
@@ -79,7 +170,9 @@ NO_RETURN void exit(int code)
         this->cwd = 0;
     }
 
-    post_sem(&(this -> parent ->childexit));
+    // threads are reaped by their leader, not waited by the parent
+    if (this->leader == this)
+        post_sem(&(this -> parent ->childexit));
     _acquire_sched_lock();
     _release_spinlock(&plock);
     _sched(ZOMBIE);
@@ -123,10 +216,7 @@ int wait(int* exitcode, int* pid)
     
             w_pid = child_proc -> localpid;
 
-            free_pid(&child_proc->container->localpidmap, child_proc -> localpid);
-            free_pid(&pidmap, child_proc -> pid);
-            kfree_page(child_proc -> kstack);
-            kfree(child_proc);
+            free_proc(child_proc);
             break;
             // _release_spinlock(&plock);
         }
@@ -135,28 +225,14 @@ int wait(int* exitcode, int* pid)
     return w_pid;
 }
 
-proc* traverse_proc(proc *p, int pid) {  
-    _for_in_list(child_node, &p -> children) {
-        if (child_node == &p -> children) continue;
-        proc* child = container_of(child_node, proc, ptnode);
-        if (child -> pid == pid) 
-            return child;
-        else {
-            proc* obj = traverse_proc(child, pid);
-            if (obj != NULL) {
-                return obj;
-            }
-        }    
-    }
-    return NULL;
-}
-
 int kill(int pid) {
     // TODO
     // Set the killed flag of the proc to true and return 0.
     // Return -1 if the pid is invalid (proc not found).
     _acquire_spinlock(&plock);
-    proc* target_proc = traverse_proc(&root_proc, pid);
+    // procs are freed with plock held, so the one found stays valid
+    PidLink* link = lookup_pid(&pidmap, pid);
+    proc* target_proc = link ? container_of(link, proc, pidlink) : NULL;
     if (target_proc == NULL || is_unused(target_proc)) {
         _release_spinlock(&plock);
         return -1;
@@ -186,38 +262,68 @@ int start_proc(struct proc* p, void(*entry)(u64), u64 arg)
     p->kcontext->x0 = (u64)entry;
     p->kcontext->x1 = (u64)arg;
     p->localpid = alloc_pid(&p->container->localpidmap);
+    link_pid(&p->localpidlink, &p->container->localpidmap, p->localpid);
     // printk("pid:%d\n", p->localpid);
     activate_proc(p);
     return p->localpid;
 }
 
-void init_proc(struct proc* p)
+// setup everything but the address space and the open files
+static void init_proc_base(struct proc* p, void* kstack)
 {
-    // TODO
-    // setup the struct proc with kstack and pid allocated
-    // NOTE: be careful of concurrency
     memset(p, 0, sizeof(*p));
     p->killed = false;
     p->pid = alloc_pid(&pidmap);
+    link_pid(&p->pidlink, &pidmap, p->pid);
     // printk("PID:%d\n", p->pid);
     p->state = UNUSED;
     init_sem(&p->childexit, 0);
+    init_sem(&p->vforkdone, 0);
     init_list_node(&p->children);
     init_list_node(&p->ptnode);
     init_schinfo(&p->schinfo, false);
-    init_pgdir(&(p->pgdir));
     p->container = &root_container;
-    p->kstack = kalloc_page();
+    p->kstack = kstack;
     p->kcontext = (KernelContext*)((u64)p->kstack + PAGE_SIZE - 16 - sizeof(KernelContext) - sizeof(UserContext));
     p->ucontext = (UserContext*)((u64)p->kstack + PAGE_SIZE - 16 -sizeof(UserContext));
-    init_oftable(&p->oftable);
     p->cwd = inodes.root;
+    p->leader = p;
+    init_list_node(&p->threads);
+    init_list_node(&p->thnode);
+}
+
+void init_proc(struct proc* p)
+{
+    // TODO
+    // setup the struct proc with kstack and pid allocated
+    // NOTE: be careful of concurrency
+    init_proc_base(p, kalloc_page());
+    p->pgdir = create_pgdir();
+    p->oftable = create_oftable();
 }
 
 struct proc* create_proc()
 {
-    struct proc* p = kalloc(sizeof(struct proc));
-    init_proc(p);
+    auto cache = &proc_cache[cpuid()];
+    struct proc* p = NULL;
+    _acquire_spinlock(&cache->lock);
+    if (!_empty_list(&cache->head)) {
+        ListNode* node = cache->head.next;
+        _detach_from_list(node);
+        cache->cnt--;
+        p = container_of(node, struct proc, ptnode);
+    }
+    _release_spinlock(&cache->lock);
+    if (p == NULL) {
+        p = kalloc(sizeof(struct proc));
+        init_proc(p);
+        return p;
+    }
+    auto pgdir = p->pgdir;
+    init_proc_base(p, p->kstack);
+    p->pgdir = pgdir;
+    _increment_rc(&pgdir->ref);
+    p->oftable = create_oftable();
     return p;
 }
 
@@ -230,7 +336,7 @@ struct proc* traverse_find_offline(struct container* container) {
         struct schinfo* schinfo_ = container_of(p, struct schinfo, rq_node);
         if (!schinfo_->iscontainer) {
             struct proc* proc = container_of(schinfo_, struct proc, schinfo);
-            if (!proc->pgdir.online) {
+            if (proc->pgdir && !proc->pgdir->online) {
                 find_proc = proc;
                 break;
             }
@@ -245,7 +351,7 @@ struct proc* traverse_find_offline(struct container* container) {
 struct proc* get_offline_proc() {
     struct proc* proc = traverse_find_offline(&root_container);
     if (proc == NULL)   PANIC();
-    _acquire_spinlock(&proc->pgdir.lock);
+    _acquire_spinlock(&proc->pgdir->lock);
     return proc;
 }
 
@@ -270,7 +376,7 @@ int fork() {
     fork_p->killed = p->killed;
     fork_p->idle = p->idle;
 
-    copy_pgdir(&p->pgdir, &fork_p->pgdir);
+    copy_pgdir(p->pgdir, fork_p->pgdir);
 
     set_parent_to_this(fork_p);
     set_container_to_this(fork_p);
@@ -280,8 +386,8 @@ int fork() {
     fork_p->ucontext->x[0] = 0;
 
     for (int i = 0; i < NOFILE; i++) {
-        if (p->oftable.ofile[i]) {
-            fork_p->oftable.ofile[i] = filedup(p->oftable.ofile[i]);
+        if (p->oftable->ofile[i]) {
+            fork_p->oftable->ofile[i] = filedup(p->oftable->ofile[i]);
         }
     }
     if (fork_p->cwd) {
@@ -291,26 +397,26 @@ int fork() {
         fork_p->cwd = NULL;
     }
 
-    // _for_in_list(node, &p->pgdir.section_head) {
-    //     if (node == &p->pgdir.section_head)  continue;
+    // _for_in_list(node, &p->pgdir->section_head) {
+    //     if (node == &p->pgdir->section_head)  continue;
 
     //     struct section* p_sec = container_of(node, struct section, stnode);
 
     //     struct section* c_sec = kalloc(sizeof(struct section));
     //     memmove(c_sec, p_sec, sizeof(struct section));
     //     init_sleeplock(&c_sec->sleeplock);
-    //     _insert_into_list(&fork_p->pgdir.section_head, &c_sec->stnode);
+    //     _insert_into_list(&fork_p->pgdir->section_head, &c_sec->stnode);
 
     //     printk("psec:%llx\n", p_sec->flags);
     //     for (u64 va = p_sec->begin; va < p_sec->end; va += PAGE_SIZE) {
     //         printk("va:%llx\n", va);
-    //         PTEntriesPtr pte = get_pte(&p->pgdir, va, false);
+    //         PTEntriesPtr pte = get_pte(p->pgdir, va, false);
     //         u64 flags = PTE_FLAGS(*pte);
 
     //         void* ka = alloc_page_for_user();
     //         memmove(ka, (void*)va, PAGE_SIZE);
 
-    //         vmmap(&fork_p->pgdir, va, ka, flags);
+    //         vmmap(fork_p->pgdir, va, ka, flags);
     //     }
     // }
 
@@ -322,3 +428,125 @@ int fork() {
 
     return pid;
 }
+
+/*
+ * Create a child borrowing the address space of the current process, which
+ * sleeps until the child calls execve or exits. The child gets its own copy
+ * of the open files and starts on the given stack, or on the stack of the
+ * parent if it is NULL.
+ */
+int vfork(void* stack)
+{
+    struct proc *p = thisproc();
+    struct proc *c = kalloc(sizeof(struct proc));
+    init_proc_base(c, kalloc_page());
+    c->pgdir = share_pgdir(p->pgdir);
+    c->oftable = create_oftable();
+    for (int i = 0; i < NOFILE; i++) {
+        if (p->oftable->ofile[i])
+            c->oftable->ofile[i] = filedup(p->oftable->ofile[i]);
+    }
+    c->cwd = p->cwd ? inodes.share(p->cwd) : NULL;
+
+    set_parent_to_this(c);
+    set_container_to_this(c);
+
+    memmove(c->ucontext, p->ucontext, sizeof(UserContext));
+    memmove(c->kcontext, p->kcontext, sizeof(KernelContext));
+    c->ucontext->x[0] = 0;
+    if (stack)
+        c->ucontext->sp_el0 = (u64)stack;
+    c->vforked = true;
+
+    int pid = c->pid;
+    start_proc(c, trap_return, 0);
+    // c can only be freed by a wait of this proc
+    unalertable_wait_sem(&c->vforkdone);
+    return pid;
+}
+
+// Called by a vfork child once it no longer uses the address space of the parent.
+void release_vfork_parent(struct proc* p)
+{
+    if (p->vforked) {
+        p->vforked = false;
+        post_sem(&p->vforkdone);
+    }
+}
+
+/*
+ * Create a thread sharing the address space, the open files and the cwd
+ * with the current process. It starts on the given user stack as if
+ * returning from clone with 0.
+ */
+int clone_thread(u64 flags, void* stack, int* ptid, u64 tls, int* ctid)
+{
+    const u64 required = CLONE_VM | CLONE_FILES | CLONE_THREAD;
+    const u64 supported = required | CLONE_FS | CLONE_SIGHAND | CLONE_SYSVSEM | CLONE_SETTLS
+                        | CLONE_PARENT_SETTID | CLONE_CHILD_CLEARTID | CLONE_DETACHED;
+    if ((flags & required) != required || (flags & ~supported & ~(u64)0xff)) {
+        printk("clone_thread: unsupported flags 0x%llx\n", flags);
+        return -1;
+    }
+    if ((flags & CLONE_PARENT_SETTID) && !user_writeable(ptid, sizeof(int)))
+        return -1;
+    struct proc *p = thisproc();
+    struct proc *leader = p->leader;
+    reap_threads(leader, false);
+
+    struct proc *t = kalloc(sizeof(struct proc));
+    init_proc_base(t, kalloc_page());
+    t->pgdir = share_pgdir(p->pgdir);
+    t->oftable = share_oftable(p->oftable);
+    t->cwd = p->cwd ? inodes.share(p->cwd) : NULL;
+    t->leader = leader;
+    // not on the children list of the leader, see reap_threads
+    t->parent = leader;
+    set_container_to_this(t);
+
+    memmove(t->ucontext, p->ucontext, sizeof(UserContext));
+    memmove(t->kcontext, p->kcontext, sizeof(KernelContext));
+    t->ucontext->x[0] = 0;
+    if (stack)
+        t->ucontext->sp_el0 = (u64)stack;
+    if (flags & CLONE_SETTLS)
+        t->ucontext->tpidr_el0 = tls;
+    if (flags & CLONE_CHILD_CLEARTID)
+        t->clear_tid = ctid;
+
+    _acquire_spinlock(&plock);
+    _insert_into_list(&leader->threads, &t->thnode);
+    _release_spinlock(&plock);
+
+    int tid = start_proc(t, trap_return, 0);
+    if (flags & CLONE_PARENT_SETTID)
+        *ptid = tid;
+    return tid;
+}
+
+// Kill the other threads of the group and wait until they are freed.
+void kill_threads()
+{
+    auto this = thisproc();
+    ASSERT(this->leader == this);
+    reap_threads(this, true);
+}
+
+NO_RETURN void exit_group(int code)
+{
+    auto this = thisproc();
+    auto leader = this->leader;
+    _acquire_spinlock(&plock);
+    // the first exit_group decides the exit code the parent sees
+    if (!leader->group_exiting) {
+        leader->group_exiting = true;
+        leader->group_exit_code = code;
+    }
+    if (leader != this) {
+        // the leader kills the rest of the group on its way out
+        leader->killed = true;
+        alert_proc(leader);
+    }
+    _release_spinlock(&plock);
+    exit(code);
+}
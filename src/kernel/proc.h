@@ -5,6 +5,7 @@
 #include <common/sem.h>
 #include <kernel/schinfo.h>
 #include <kernel/pt.h>
+#include <kernel/pid.h>
 #include <kernel/container.h>
 #include <fs/file.h>
 
@@ -57,13 +58,23 @@ typedef struct proc
     ListNode ptnode;
     struct proc* parent;
     struct schinfo schinfo;
-    struct pgdir pgdir;
+    struct pgdir* pgdir;
     struct container* container;
     void* kstack;
     UserContext* ucontext;
     KernelContext* kcontext;
-    struct oftable oftable;
+    struct oftable* oftable;
     Inode* cwd; // current working dictionary
+    struct proc* leader; // the thread group leader, itself for a process
+    ListNode threads; // other threads of the group, only used by the leader
+    ListNode thnode;
+    bool group_exiting; // exit_group was called, only set on the leader
+    int group_exit_code;
+    int* clear_tid; // cleared and woken up on thread exit
+    bool vforked; // still borrowing the address space of the parent
+    Semaphore vforkdone; // posted when a vfork child execs or exits
+    PidLink pidlink; // found by pid in the pid hash
+    PidLink localpidlink; // found by localpid in the pid hash
 } proc;
 
 // void init_proc(struct proc*);
@@ -71,7 +82,12 @@ WARN_RESULT struct proc* create_proc();
 void set_parent_to_this(struct proc*);
 int start_proc(struct proc*, void(*entry)(u64), u64 arg);
 NO_RETURN void exit(int code);
+NO_RETURN void exit_group(int code);
+void kill_threads();
 WARN_RESULT int wait(int* exitcode, int* pid);
 WARN_RESULT int kill(int pid);
 WARN_RESULT int fork();
+WARN_RESULT int vfork(void* stack);
+void release_vfork_parent(struct proc*);
+WARN_RESULT int clone_thread(u64 flags, void* stack, int* ptid, u64 tls, int* ctid);
 struct proc* get_offline_proc();
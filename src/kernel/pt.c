@@ -57,6 +57,21 @@ void init_pgdir(struct pgdir* pgdir)
     init_list_node(&pgdir->section_head);
     //create_file_sections(&pgdir->section_head);
     pgdir->online = false;
+    init_rc(&pgdir->ref);
+}
+
+struct pgdir* create_pgdir()
+{
+    struct pgdir* pgdir = kalloc(sizeof(struct pgdir));
+    init_pgdir(pgdir);
+    _increment_rc(&pgdir->ref);
+    return pgdir;
+}
+
+struct pgdir* share_pgdir(struct pgdir* pgdir)
+{
+    _increment_rc(&pgdir->ref);
+    return pgdir;
 }
 
 void copy_pgdir(struct pgdir* from_pgdir, struct pgdir* to_pgdir) {
@@ -77,6 +92,12 @@ void copy_pgdir(struct pgdir* from_pgdir, struct pgdir* to_pgdir) {
             u64 flags = PTE_FLAGS(*pte);
 			u64 from_ka = P2K(PTE_ADDRESS(*pte));
 
+            if (from_section->flags & ST_SHARED) {
+                page_ref_plus((void*)from_ka);
+                vmmap(to_pgdir, va, (void*)from_ka, flags);
+                continue;
+            }
+
             void* ka = alloc_page_for_user();
             memmove(ka, (void*)from_ka, PAGE_SIZE);
 
@@ -110,22 +131,58 @@ void free_pgdir(struct pgdir* pgdir)
 
 }
 
+/*
+ * Drop a reference to the pgdir. The last one frees the sections and the
+ * lower-level tables, leaves the pgdir with an empty top-level table so that
+ * it can be used again, and returns true.
+ */
+bool release_pgdir(struct pgdir* pgdir)
+{
+    if (!_decrement_rc(&pgdir->ref))
+        return false;
+    free_sections(pgdir);
+    if (pgdir->pt) {
+        for (u32 i = 0; i < N_PTE_PER_TABLE; i++) {
+            if (pgdir->pt[i])
+                traverse_free((PTEntriesPtr)P2K(PTE_ADDRESS(pgdir->pt[i])), 3);
+        }
+        memset(pgdir->pt, 0, PAGE_SIZE);
+    }
+    pgdir->online = false;
+    return true;
+}
+
+// free the pgdir when its last user puts it
+void put_pgdir(struct pgdir* pgdir)
+{
+    if (release_pgdir(pgdir)) {
+        free_pgdir(pgdir);
+        kfree(pgdir);
+    }
+}
+
 void attach_pgdir(struct pgdir* pgdir)
 {
     extern PTEntries invalid_pt;
-    _acquire_spinlock(&thisproc()->pgdir.lock);
-    thisproc()->pgdir.online = false;
-    _release_spinlock(&thisproc()->pgdir.lock);
+    // an exited thread has already dropped its pgdir
+    if (thisproc()->pgdir) {
+        _acquire_spinlock(&thisproc()->pgdir->lock);
+        thisproc()->pgdir->online = false;
+        _release_spinlock(&thisproc()->pgdir->lock);
+    }
     
-    if (pgdir->pt) 
+    // nor has one switched back in to finish its exit
+    if (pgdir && pgdir->pt) 
         arch_set_ttbr0(K2P(pgdir->pt));
     
     else
         arch_set_ttbr0(K2P(&invalid_pt));
     
-    _acquire_spinlock(&pgdir->lock);
-    pgdir->online = true;
-    _release_spinlock(&pgdir->lock);
+    if (pgdir) {
+        _acquire_spinlock(&pgdir->lock);
+        pgdir->online = true;
+        _release_spinlock(&pgdir->lock);
+    }
 }
 
 /*
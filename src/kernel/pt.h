@@ -2,6 +2,7 @@
 
 #include <aarch64/mmu.h>
 #include <common/list.h>
+#include <common/rc.h>
 
 #define IS_VALID(va) ((u64)va & PTE_VALID)
 
@@ -11,12 +12,17 @@ struct pgdir
     SpinLock lock; 
     ListNode section_head;
     bool online;
+    RefCount ref; // threads of a process share one pgdir
 };
 
 void init_pgdir(struct pgdir* pgdir);
 WARN_RESULT PTEntriesPtr get_pte(struct pgdir* pgdir, u64 va, bool alloc);
 void vmmap(struct pgdir* pd, u64 va, void* ka, u64 flags);
 void free_pgdir(struct pgdir* pgdir);
+WARN_RESULT struct pgdir* create_pgdir();
+struct pgdir* share_pgdir(struct pgdir* pgdir);
+WARN_RESULT bool release_pgdir(struct pgdir* pgdir);
+void put_pgdir(struct pgdir* pgdir);
 void attach_pgdir(struct pgdir* pgdir);
 int copyout(struct pgdir* pd, void* va, void *p, usize len);
 void create_stack_section(struct pgdir* pd, u64 va);
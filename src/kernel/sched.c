@@ -7,6 +7,7 @@
 #include <kernel/cpu.h>
 #include <driver/clock.h>
 #include <kernel/container.h>
+#include <common/sem.h>
 
 extern bool panic_flag;
 extern struct container root_container;
@@ -18,7 +19,7 @@ static SpinLock schlock;
 extern struct timer sched_timer[4];
 
 define_early_init(schlock) {
-    init_spinlock(&schlock);
+    init_named_spinlock(&schlock, "schlock");
 }
 
 define_init(sched) {
@@ -28,6 +29,7 @@ define_init(sched) {
         p->pid = 0;
         p->killed = false;
         p->state = RUNNING;
+        p->pgdir = create_pgdir();
         cpus[i].sched.thisproc = cpus[i].sched.idle = p;
     }
 }
@@ -49,6 +51,7 @@ void init_schinfo(struct schinfo* p, bool group)
     init_list_node(&p -> rq_node);
     p -> start_ = 0;
     p -> occupy_ = 0;
+    p -> nsleep = 0;
     p -> iscontainer = group;
 }
 
@@ -125,6 +128,9 @@ static void update_this_state(enum procstate new_state)
         _insert_into_list(&this->container->schqueue.rq, &(this -> schinfo.rq_node)); 
     }
     this -> state = new_state;
+    if (new_state == SLEEPING || new_state == DEEPSLEEPING) {
+        this -> schinfo.nsleep++;
+    }
 
     if (this == cpus[cpuid()].sched.idle) {
         return;
@@ -250,7 +256,7 @@ static void simple_sched(enum procstate new_state)
     ASSERT(next->state == RUNNABLE);
     next->state = RUNNING;
     if (next != this) {
-        attach_pgdir(&(next -> pgdir));
+        attach_pgdir(next->pgdir);
         swtch(next->kcontext, &this->kcontext);
     }
     _release_sched_lock();
@@ -258,6 +264,14 @@ static void simple_sched(enum procstate new_state)
 
 __attribute__((weak, alias("simple_sched"))) void _sched(enum procstate new_state);
 
+bool sleep_ms(u64 ms)
+{
+    // nobody posts it, so only the timeout (or an alert) can wake us up
+    Semaphore sem;
+    init_sem(&sem, 0);
+    return wait_sem_timeout(&sem, ms) == 0;
+}
+
 u64 proc_entry(void(*entry)(u64), u64 arg)
 {
     _release_sched_lock();
@@ -21,3 +21,7 @@ void _sched(enum procstate new_state);
 #define yield() (_acquire_sched_lock(), _sched(RUNNABLE))
 
 WARN_RESULT struct proc* thisproc();
+
+// sleep for at least ms milliseconds without occupying the cpu.
+// return false if woken up early (e.g. killed).
+WARN_RESULT bool sleep_ms(u64 ms);
@@ -20,6 +20,7 @@ struct schinfo
     bool iscontainer;
     u64 start_;
     u64 occupy_;
+    u64 nsleep; // times the proc blocked
 };
 
 // embedded data for containers
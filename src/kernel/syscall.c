@@ -28,7 +28,7 @@ bool user_readable(const void* start, usize size) {
     u64 n;
     while (size > 0) {
         va_base = PAGE_BASE(va);
-        PTEntriesPtr pte = get_pte(&thisproc()->pgdir, va_base, false);
+        PTEntriesPtr pte = get_pte(thisproc()->pgdir, va_base, false);
         if (pte == NULL) {
             return false;
         }
@@ -52,7 +52,7 @@ bool user_writeable(const void* start, usize size) {
     u64 n;
     while (size > 0) {
         va_base = PAGE_BASE(va);
-        PTEntriesPtr pte = get_pte(&thisproc()->pgdir, va_base, false);
+        PTEntriesPtr pte = get_pte(thisproc()->pgdir, va_base, false);
         if (pte == NULL) {
             return false;
         }
@@ -3,6 +3,8 @@
 
 #define SYS_myreport 499
 #define SYS_pstat 500
+#define SYS_lockstat 501
+#define SYS_bcachestat 502
 #define SYS_sbrk 12
 
 #define SYS_clone 220
@@ -5,6 +5,7 @@
 //
 
 #include <fcntl.h>
+#include <sys/mman.h>
 
 #include <aarch64/mmu.h>
 #include <common/defines.h>
@@ -39,7 +40,7 @@ static struct file* fd2file(int fd) {
     struct file *f = NULL;
     struct proc* proc = thisproc();
     if (fd >= 0 && fd < NOFILE) {
-        f = proc->oftable.ofile[fd];
+        f = proc->oftable->ofile[fd];
     }
     return f;
 }
@@ -50,13 +51,16 @@ static struct file* fd2file(int fd) {
  */
 int fdalloc(struct file* f) {
     int fd;
-    struct proc* proc = thisproc();
+    struct oftable* oftable = thisproc()->oftable;
+    _acquire_spinlock(&oftable->lock);
     for (fd = 0; fd < NOFILE; fd++) {
-        if (proc->oftable.ofile[fd] == 0) {
-            proc->oftable.ofile[fd] = f;
+        if (oftable->ofile[fd] == 0) {
+            oftable->ofile[fd] = f;
+            _release_spinlock(&oftable->lock);
             return fd;
         }
     }
+    _release_spinlock(&oftable->lock);
     return -1;
 }
 
@@ -69,9 +73,15 @@ define_syscall(ioctl, int fd, u64 request) {
 /*
  *	map addr to a file
  */
-// define_syscall(mmap, void* addr, int length, int prot, int flags, int fd, int offset) {
-//     // TODO
-// }
+// only anonymous mappings are supported, and addr is just a hint.
+define_syscall(mmap, void* addr, usize length, int prot, int flags, int fd, isize offset) {
+    (void)addr, (void)offset;
+    if (!(flags & MAP_ANONYMOUS) || fd != -1) {
+        printk("sys_mmap: file mapping is not supported.\n");
+        return -1;
+    }
+    return mmap_anonymous(thisproc()->pgdir, length, flags & MAP_SHARED, prot & PROT_WRITE);
+}
 
 // define_syscall(munmap, void *addr, usize length) {
 //     // TODO
@@ -133,8 +143,11 @@ define_syscall(writev, int fd, struct iovec *iov, int iovcnt) {
  * Clear this fd of this process.
  */
 define_syscall(close, int fd) {
-    struct file* f = thisproc()->oftable.ofile[fd];
-    thisproc()->oftable.ofile[fd] = 0;
+    struct oftable* oftable = thisproc()->oftable;
+    _acquire_spinlock(&oftable->lock);
+    struct file* f = oftable->ofile[fd];
+    oftable->ofile[fd] = 0;
+    _release_spinlock(&oftable->lock);
     fileclose(f);
     return 0;
 }
@@ -195,7 +208,6 @@ define_syscall(unlinkat, int fd, const char* path, int flag) {
     // printk("at unlinkat\n");
     ASSERT(fd == AT_FDCWD && flag == 0);
     Inode *ip, *dp;
-    DirEntry de;
     char name[FILE_NAME_MAX_LENGTH];
     usize off;
     if (!user_strlen(path, 256))
@@ -228,9 +240,7 @@ define_syscall(unlinkat, int fd, const char* path, int flag) {
         goto bad;
     }
 
-    memset(&de, 0, sizeof(de));
-    if (inodes.write(&ctx, dp, (u8*)&de, off, sizeof(de)) != sizeof(de))
-        PANIC();
+    inodes.remove(&ctx, dp, off);
     if (ip->entry.type == INODE_DIRECTORY) {
         dp->entry.num_links--;
         inodes.sync(&ctx, dp, true);
@@ -302,7 +312,18 @@ Inode* create(const char* path, short type, short major, short minor, OpContext*
         inodes.insert(ctx, ip, ".", ip->inode_no);
         inodes.insert(ctx, ip, "..", dp->inode_no);
     }
-    inodes.insert(ctx, dp, name, ip->inode_no);
+    if (inodes.insert(ctx, dp, name, ip->inode_no) == (usize)-1) {
+        // the directory is full, drop the new inode.
+        if (type == INODE_DIRECTORY)
+            dp->entry.num_links--;
+        ip->entry.num_links = 0;
+        inodes.sync(ctx, ip, true);
+        inodes.unlock(ip);
+        inodes.put(ctx, ip);
+        inodes.unlock(dp);
+        inodes.put(ctx, dp);
+        return 0;
+    }
 
     inodes.unlock(ip);
     inodes.unlock(dp);
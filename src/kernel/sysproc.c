@@ -4,6 +4,9 @@
 #include <kernel/proc.h>
 #include <kernel/mem.h>
 #include <kernel/paging.h>
+#include <driver/clock.h>
+#include <fs/cache.h>
+#include <time.h>
 
 define_syscall(gettid) {
     return thisproc()->localpid;
@@ -36,17 +39,85 @@ define_syscall(pstat) {
     return (u64)left_page_cnt();
 }
 
-define_syscall(sbrk, i64 size) {
-    return sbrk(size);
+// there is no rtc, so every clock counts from boot with a resolution of 1ms.
+define_syscall(clock_gettime, int clockid, struct timespec* tp) {
+    (void)clockid;
+    if (!user_writeable(tp, sizeof(struct timespec)))
+        return -1;
+    u64 now = get_timestamp_ms();
+    tp->tv_sec = now / 1000;
+    tp->tv_nsec = now % 1000 * 1000000;
+    return 0;
 }
 
-define_syscall(clone, int flag, void* childstk) {
-    if (flag != 17) {
-        printk("sys_clone: flags other than SIGCHLD are not supported.\n");
+static int do_nanosleep(u64 deadline, struct timespec* rem) {
+    u64 now = get_timestamp_ms();
+    if (deadline > now && !sleep_ms(deadline - now)) {
+        now = get_timestamp_ms();
+        if (rem) {
+            u64 left = deadline > now ? deadline - now : 0;
+            rem->tv_sec = left / 1000;
+            rem->tv_nsec = left % 1000 * 1000000;
+        }
         return -1;
     }
-    ASSERT((u64)childstk || true);
-    return fork();
+    return 0;
+}
+
+static bool read_timespec_ms(const struct timespec* ts, u64* ms) {
+    if (!user_readable(ts, sizeof(struct timespec)))
+        return false;
+    if (ts->tv_sec < 0 || ts->tv_nsec < 0 || ts->tv_nsec >= 1000000000)
+        return false;
+    // round up, never sleep shorter than requested
+    *ms = (u64)ts->tv_sec * 1000 + ((u64)ts->tv_nsec + 999999) / 1000000;
+    return true;
+}
+
+define_syscall(nanosleep, const struct timespec* req, struct timespec* rem) {
+    u64 ms;
+    if (!read_timespec_ms(req, &ms) || (rem && !user_writeable(rem, sizeof(struct timespec))))
+        return -1;
+    return do_nanosleep(get_timestamp_ms() + ms, rem);
+}
+
+define_syscall(clock_nanosleep, int clockid, int flags, const struct timespec* req, struct timespec* rem) {
+    (void)clockid;
+    u64 ms;
+    if (!read_timespec_ms(req, &ms) || (rem && !user_writeable(rem, sizeof(struct timespec))))
+        return -1;
+    if (flags & TIMER_ABSTIME)
+        return do_nanosleep(ms, NULL);
+    return do_nanosleep(get_timestamp_ms() + ms, rem);
+}
+
+define_syscall(lockstat) {
+    dump_lock_stat();
+    return 0;
+}
+
+// copy out the block cache statistics, and set its maximum capacity if
+// max_capacity is positive.
+define_syscall(bcachestat, BlockCacheStat* stat, i64 max_capacity) {
+    if (stat && !user_writeable(stat, sizeof(BlockCacheStat)))
+        return -1;
+    if (max_capacity > 0)
+        set_bcache_max_capacity(max_capacity);
+    if (stat)
+        get_bcache_stat(stat);
+    return 0;
+}
+
+define_syscall(sbrk, i64 size) {
+    return sbrk(size);
+}
+
+define_syscall(clone, u64 flag, void* childstk, int* ptid, u64 tls, int* ctid) {
+    if (flag == 17) // SIGCHLD
+        return fork();
+    if (flag == 0x4111) // CLONE_VM | CLONE_VFORK | SIGCHLD, vfork and posix_spawn
+        return vfork(childstk);
+    return clone_thread(flag, childstk, ptid, tls, ctid);
 }
 
 define_syscall(myexit, int n) {
@@ -58,7 +129,7 @@ define_syscall(exit, int n) {
 }
 
 define_syscall(exit_group, int n) {
-    exit(n);
+    exit_group(n);
 }
 
 int execve(const char* path, char* const argv[], char* const envp[]);
@@ -69,7 +140,7 @@ define_syscall(execve, const char* p, void* argv, void* envp) {
 }
 
 define_syscall(wait4, int pid, int options, int* wstatus, void* rusage) {
-    if (pid != -1 || wstatus != 0 || options != 0 || rusage != 0) {
+    if (pid != -1 || options != 0 || rusage != 0) {
         printk("sys_wait4: unimplemented. pid %d, wstatus 0x%p, options 0x%x, rusage 0x%p\n",
                pid,
                wstatus,
@@ -78,6 +149,12 @@ define_syscall(wait4, int pid, int options, int* wstatus, void* rusage) {
         while (1) {}
         return -1;
     }
+    if (wstatus && !user_writeable(wstatus, sizeof(int)))
+        return -1;
     int code, id;
-    return wait(&code, &id);
+    int ret = wait(&code, &id);
+    // every child exits normally, as far as WEXITSTATUS can tell
+    if (ret > 0 && wstatus)
+        *wstatus = (code & 0xff) << 8;
+    return ret;
 }
@@ -0,0 +1,60 @@
+#include <kernel/sched.h>
+#include <kernel/proc.h>
+#include <kernel/printk.h>
+#include <aarch64/intrinsic.h>
+#include <test/test.h>
+
+#define NVICTIM 4096
+// a kill is a hash lookup, it must not grow with the number of procs
+#define MAX_KILL_US 100
+
+void set_parent_to_this(struct proc* proc);
+
+static Semaphore never;
+static int victim_pid[NVICTIM];
+
+static void victim(u64 i)
+{
+    (void)i;
+    // only returns when killed
+    ASSERT(!wait_sem(&never));
+    exit(0);
+}
+
+void kill_test()
+{
+    printk("kill_test\n");
+    init_sem(&never, 0);
+    for (int i = 0; i < NVICTIM; i++)
+    {
+        auto p = create_proc();
+        ASSERT(p->pid > 0);
+        victim_pid[i] = p->pid;
+        set_parent_to_this(p);
+        start_proc(p, victim, i);
+    }
+    u64 sum = 0, max = 0;
+    // kill the youngest first, the deepest in a walk of the proc tree
+    for (int i = NVICTIM - 1; i >= 0; i--)
+    {
+        u64 t0 = get_timestamp();
+        ASSERT(kill(victim_pid[i]) == 0);
+        u64 t = get_timestamp() - t0;
+        sum += t;
+        max = MAX(max, t);
+    }
+    for (int i = 0; i < NVICTIM; i++)
+    {
+        int code, id;
+        ASSERT(wait(&code, &id) != -1);
+        ASSERT(code == 0);
+    }
+    ASSERT(kill(victim_pid[0]) == -1);
+    u64 per_us = get_clock_frequency() / 1000000;
+    u64 avg_us = sum / NVICTIM / per_us;
+    printk("kill_test: %d procs, kill avg %lld us max %lld us\n",
+           NVICTIM, avg_us, max / per_us);
+    // the max may include an interrupt or a wait for plock
+    ASSERT(avg_us <= MAX_KILL_US);
+    printk("kill_test PASS\n");
+}
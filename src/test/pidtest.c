@@ -0,0 +1,57 @@
+#include <kernel/pid.h>
+#include <kernel/mem.h>
+#include <kernel/printk.h>
+#include <common/string.h>
+#include <aarch64/intrinsic.h>
+#include <test/test.h>
+
+#define NROUND 10000
+
+static const int nlive[] = {10, 1000, 30000};
+static int live[30000];
+static bool used[PID_MAX];
+
+// A fork storm on a private pidmap: with n pids alive, every round one of
+// them exits and a new one is forked.
+void pid_test()
+{
+    printk("pid_test\n");
+    srand(2023);
+    pidmap_t map;
+    u64* words = kalloc_page();
+    u64 per_us = get_clock_frequency() / 1000000;
+    for (int k = 0; k < (int)(sizeof(nlive) / sizeof(nlive[0])); k++)
+    {
+        int n = nlive[k];
+        init_pidmap(&map, words);
+        memset(used, 0, sizeof(used));
+        for (int i = 0; i < n; i++)
+        {
+            ASSERT((live[i] = alloc_pid(&map)) == i + 1);
+            used[live[i]] = true;
+        }
+        u64 sum = 0, max = 0;
+        for (int r = 0; r < NROUND; r++)
+        {
+            int i = rand() % n;
+            free_pid(&map, live[i]);
+            used[live[i]] = false;
+            u64 t0 = get_timestamp();
+            live[i] = alloc_pid(&map);
+            u64 t = get_timestamp() - t0;
+            sum += t;
+            max = MAX(max, t);
+            ASSERT(live[i] > 0 && live[i] < PID_MAX);
+            // once the cursor wraps around a freed pid may come back, but
+            // never one that is still alive
+            ASSERT(!used[live[i]]);
+            used[live[i]] = true;
+        }
+        ASSERT(map.free_num == PID_MAX - 1 - n);
+        // clock ticks per microsecond, so this is in ns
+        printk("pid_test: %d live pids, alloc_pid avg %lld ns max %lld ns\n",
+               n, sum * 1000 / NROUND / per_us, max * 1000 / per_us);
+    }
+    kfree_page(words);
+    printk("pid_test PASS\n");
+}
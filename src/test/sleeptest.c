@@ -0,0 +1,66 @@
+#include <kernel/sched.h>
+#include <kernel/proc.h>
+#include <kernel/cpu.h>
+#include <kernel/printk.h>
+#include <driver/clock.h>
+#include <aarch64/intrinsic.h>
+#include <test/test.h>
+
+#define NSLEEPER 1000
+#define MAX_SLEEP_MS 500
+// a wakeup is late if it misses the deadline by more than a few sched ticks
+#define MAX_LATENESS_MS 20
+
+void set_parent_to_this(struct proc* proc);
+
+static int duration[NSLEEPER];
+static u64 lateness[NSLEEPER];
+static u64 occupy[NSLEEPER];
+
+static void sleeper(u64 i)
+{
+    u64 t0 = get_timestamp_ms();
+    ASSERT(sleep_ms(duration[i]));
+    u64 slept = get_timestamp_ms() - t0;
+    ASSERT(slept >= (u64)duration[i]);
+    lateness[i] = slept - duration[i];
+    occupy[i] = thisproc()->schinfo.occupy_;
+    exit(0);
+}
+
+void sleep_test()
+{
+    printk("sleep_test\n");
+    srand(2023);
+    for (int i = 0; i < NSLEEPER; i++)
+        duration[i] = rand() % MAX_SLEEP_MS + 1;
+    u64 t0 = get_timestamp_ms();
+    for (int i = 0; i < NSLEEPER; i++)
+    {
+        auto p = create_proc();
+        set_parent_to_this(p);
+        start_proc(p, sleeper, i);
+    }
+    for (int i = 0; i < NSLEEPER; i++)
+    {
+        int code, id;
+        ASSERT(wait(&code, &id) != -1);
+        ASSERT(code == 0);
+    }
+    u64 elapsed = get_timestamp_ms() - t0;
+    u64 max_late = 0, sum_late = 0, sum_occupy = 0;
+    for (int i = 0; i < NSLEEPER; i++)
+    {
+        max_late = MAX(max_late, lateness[i]);
+        sum_late += lateness[i];
+        sum_occupy += occupy[i];
+    }
+    // occupy_ is counted in timer ticks
+    u64 busy_ms = sum_occupy / (get_clock_frequency() / 1000);
+    printk("sleep_test: %d sleepers, %lld ms elapsed, lateness avg %lld ms max %lld ms, cpu %lld ms\n",
+           NSLEEPER, elapsed, sum_late / NSLEEPER, max_late, busy_ms);
+    ASSERT(max_late <= MAX_LATENESS_MS);
+    // sleepers must not spin: they should use a tiny fraction of the cpu time
+    ASSERT(busy_ms * 10 < elapsed * NCPU);
+    printk("sleep_test PASS\n");
+}
@@ -12,5 +12,9 @@ void user_proc_test();
 void sd_test();
 void pgfault_first_test();
 void pgfault_second_test();
+void sleep_test();
+void wakeup_test();
+void kill_test();
+void pid_test();
 unsigned rand();
 void srand(unsigned seed);
\ No newline at end of file
@@ -70,12 +70,12 @@ static void _create_user_proc(int i)
     auto p = create_proc();
     for (u64 q = (u64)loop_start; q < (u64)loop_end; q += PAGE_SIZE)
     {
-        *get_pte(&p->pgdir, 0x400000 + q - (u64)loop_start, true) = K2P(q) | PTE_USER_DATA;
+        *get_pte(p->pgdir, 0x400000 + q - (u64)loop_start, true) = K2P(q) | PTE_USER_DATA;
     }
-    ASSERT(p->pgdir.pt);
+    ASSERT(p->pgdir->pt);
     p->ucontext->x[0] = i;
     p->ucontext->elr = 0x400000;
-    // p->ucontext->ttbr0 = K2P(p->pgdir.pt);
+    // p->ucontext->ttbr0 = K2P(p->pgdir->pt);
     p->ucontext->spsr = 0;
     pids[i] = p->pid;
     set_parent_to_this(p);
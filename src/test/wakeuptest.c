@@ -0,0 +1,96 @@
+#include <kernel/sched.h>
+#include <kernel/proc.h>
+#include <kernel/printk.h>
+#include <fs/pipe.h>
+#include <fs/cache.h>
+#include <test/test.h>
+
+#define NWAITER 32
+#define BYTES_PER_READER 8
+#define OPS_PER_PROC 4
+
+void set_parent_to_this(struct proc* proc);
+extern BlockCache bcache;
+
+static Pipe* pipe;
+static u64 nsleep[NWAITER];
+
+static void pipe_reader(u64 i)
+{
+    for (int j = 0; j < BYTES_PER_READER; j++)
+    {
+        char c;
+        ASSERT(pipeRead(pipe, (u64)&c, 1) == 1);
+    }
+    nsleep[i] = thisproc()->schinfo.nsleep;
+    exit(0);
+}
+
+static void log_user(u64 i)
+{
+    for (int j = 0; j < OPS_PER_PROC; j++)
+    {
+        OpContext ctx;
+        bcache.begin_op(&ctx);
+        yield();
+        bcache.end_op(&ctx);
+    }
+    nsleep[i] = thisproc()->schinfo.nsleep;
+    exit(0);
+}
+
+static u64 run_waiters(void (*entry)(u64), void (*feed)())
+{
+    for (int i = 0; i < NWAITER; i++)
+    {
+        auto p = create_proc();
+        set_parent_to_this(p);
+        start_proc(p, entry, i);
+    }
+    if (feed)
+        feed();
+    u64 total = 0;
+    for (int i = 0; i < NWAITER; i++)
+    {
+        int code, id;
+        ASSERT(wait(&code, &id) != -1);
+    }
+    for (int i = 0; i < NWAITER; i++)
+        total += nsleep[i];
+    return total;
+}
+
+static void feed_pipe()
+{
+    // one byte at a time, so that every write finds the readers asleep
+    for (int i = 0; i < NWAITER * BYTES_PER_READER; i++)
+    {
+        char c = (char)i;
+        ASSERT(pipeWrite(pipe, (u64)&c, 1) == 1);
+        yield();
+    }
+}
+
+// With wake-all, every byte written to the pipe wakes all the blocked
+// readers and all but one go back to sleep, i.e. ~NWAITER sleeps per byte.
+// With exclusive wakeups a reader sleeps about once per byte it reads.
+void wakeup_test()
+{
+    printk("wakeup_test\n");
+    File *r, *w;
+    ASSERT(pipeAlloc(&r, &w) == 0);
+    pipe = r->pipe;
+    u64 bytes = NWAITER * BYTES_PER_READER;
+    u64 pipe_sleeps = run_waiters(pipe_reader, feed_pipe);
+    printk("wakeup_test: %d readers, %lld bytes, %lld sleeps\n", NWAITER, bytes, pipe_sleeps);
+    ASSERT(pipe_sleeps <= 2 * bytes);
+    fileclose(r);
+    fileclose(w);
+
+    // an op sleeps at most once for log space and once for the commit
+    u64 ops = NWAITER * OPS_PER_PROC;
+    u64 log_sleeps = run_waiters(log_user, NULL);
+    printk("wakeup_test: %d log users, %lld ops, %lld sleeps\n", NWAITER, ops, log_sleeps);
+    ASSERT(log_sleeps <= 3 * ops);
+    printk("wakeup_test PASS\n");
+}
@@ -58,6 +58,7 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+void append_entries(uint inum, struct dirent *des, int n);
 
 // convert to little-endian byte order
 ushort xshort(ushort x) {
@@ -84,6 +85,8 @@ int main(int argc, char *argv[]) {
     struct dirent de;
     char buf[BSIZE];
     InodeEntry din;
+    static struct dirent files[NINODES];
+    int nfiles = 0;
 
     static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
@@ -171,10 +174,11 @@ int main(int argc, char *argv[]) {
 
         inum = ialloc(INODE_REGULAR);
 
-        bzero(&de, sizeof(de));
-        de.inode_no = xshort(inum);
-        strncpy(de.name, argv[i], DIRSIZ);
-        iappend(rootino, &de, sizeof(de));
+        assert(nfiles < NINODES);
+        bzero(&files[nfiles], sizeof(de));
+        files[nfiles].inode_no = xshort(inum);
+        strncpy(files[nfiles].name, argv[i], DIRSIZ);
+        nfiles++;
 
         while ((cc = read(fd, buf, sizeof(buf))) > 0)
             iappend(inum, buf, cc);
@@ -182,10 +186,12 @@ int main(int argc, char *argv[]) {
         close(fd);
     }
 
+    append_entries(rootino, files, nfiles);
+
     // fix size of root inode dir
     rinode(rootino, &din);
     off = xint(din.num_bytes);
-    off = ((off / BSIZE) + 1) * BSIZE;
+    off = (off + BSIZE - 1) / BSIZE * BSIZE;
     din.num_bytes = xint(off);
     winode(rootino, &din);
 
@@ -267,6 +273,62 @@ void balloc(int used) {
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// entries put in a leaf, leaving room for later ones.
+#define LEAF_FILL (DIR_PER_BLOCK * 3 / 4)
+
+int cmp_hash(const void *a, const void *b) {
+    uint x = dir_hash(((const struct dirent *)a)->name);
+    uint y = dir_hash(((const struct dirent *)b)->name);
+    return x < y ? -1 : x > y;
+}
+
+// append the `n` entries `des` to the directory `inum`, which holds "." and
+// "..". if they do not fit in `DIR_LINEAR_MAX_BLOCKS` blocks, the directory
+// is indexed, see `fs/defines.h`.
+void append_entries(uint inum, struct dirent *des, int n) {
+    if (n + 2 <= (int)(DIR_LINEAR_MAX_BLOCKS * DIR_PER_BLOCK)) {
+        iappend(inum, des, n * sizeof(struct dirent));
+        return;
+    }
+
+    qsort(des, n, sizeof(struct dirent), cmp_hash);
+
+    // the root, after "." and "..".
+    char root[BSIZE - DX_ROOT_OFFSET];
+    bzero(root, sizeof(root));
+    DxHeader *header = (DxHeader *)root;
+    DxEntry *entries = (DxEntry *)(header + 1);
+    header->magic = xint(DX_MAGIC);
+    header->levels = 0;
+
+    // leaves start at block 1, and a hash never spans two of them.
+    int count = 0;
+    for (int i = 0; i < n;) {
+        int j = min(i + (int)LEAF_FILL, n);
+        while (j < n && dir_hash(des[j - 1].name) == dir_hash(des[j].name))
+            j++;
+        assert(j - i <= (int)DIR_PER_BLOCK);
+        assert(count < (int)DX_ROOT_ENTRIES);
+        entries[count].hash = xint(count == 0 ? 0 : dir_hash(des[i].name));
+        entries[count].block = xint(count + 1);
+        count++;
+        i = j;
+    }
+    header->count = xshort(count);
+    iappend(inum, root, sizeof(root));
+
+    for (int i = 0; i < n;) {
+        int j = min(i + (int)LEAF_FILL, n);
+        while (j < n && dir_hash(des[j - 1].name) == dir_hash(des[j].name))
+            j++;
+        char leaf[BSIZE];
+        bzero(leaf, sizeof(leaf));
+        memmove(leaf, des + i, (j - i) * sizeof(struct dirent));
+        iappend(inum, leaf, sizeof(leaf));
+        i = j;
+    }
+}
+
 void iappend(uint inum, void *xp, int n) {
     char *p = (char *)xp;
     uint fbn, off, n1;
@@ -286,7 +348,7 @@ void iappend(uint inum, void *xp, int n) {
                 din.addrs[fbn] = xint(freeblock++);
             }
             x = xint(din.addrs[fbn]);
-        } else {
+        } else if (fbn < NDIRECT + NINDIRECT) {
             if (xint(din.indirect) == 0) {
                 din.indirect = xint(freeblock++);
             }
@@ -296,6 +358,23 @@ void iappend(uint inum, void *xp, int n) {
                 wsect(xint(din.indirect), (char *)indirect);
             }
             x = xint(indirect[fbn - NDIRECT]);
+        } else {
+            uint k = fbn - NDIRECT - NINDIRECT;
+            if (xint(din.double_indirect) == 0) {
+                din.double_indirect = xint(freeblock++);
+            }
+            rsect(xint(din.double_indirect), (char *)indirect);
+            if (indirect[k / NINDIRECT] == 0) {
+                indirect[k / NINDIRECT] = xint(freeblock++);
+                wsect(xint(din.double_indirect), (char *)indirect);
+            }
+            uint y = xint(indirect[k / NINDIRECT]);
+            rsect(y, (char *)indirect);
+            if (indirect[k % NINDIRECT] == 0) {
+                indirect[k % NINDIRECT] = xint(freeblock++);
+                wsect(y, (char *)indirect);
+            }
+            x = xint(indirect[k % NINDIRECT]);
         }
         n1 = min(n, (fbn + 1) * BSIZE - off);
         rsect(x, buf);
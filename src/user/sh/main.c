@@ -1,5 +1,6 @@
 // Shell.
 
+#define _GNU_SOURCE
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -56,15 +57,16 @@ int fork1(void);  // Fork but panics on failure.
 
 struct cmd *parsecmd(char *);
 
-void *malloc1(size_t sz) {
 #define MAXN 10000
+static size_t memused;  // reset by the shell before parsing a simple command
+
+void *malloc1(size_t sz) {
     static char mem[MAXN];
-    static size_t i;
-    if ((i += sz) > MAXN) {
+    if ((memused += sz) > MAXN) {
         fprintf(stderr, "malloc1: memory used out\n");
         exit(1);
     }
-    return &mem[i - sz];
+    return &mem[memused - sz];
 }
 
 void PANIC(char *s) {
@@ -146,6 +148,42 @@ void runcmd(struct cmd *cmd) {
     exit(0);
 }
 
+// Whether buf holds a command without redirections, pipes or lists,
+// which the shell can parse itself without risking a panic.
+int simplecmd(char *buf) {
+    if (strpbrk(buf, "<>|&;()"))
+        return 0;
+    int n = 0;
+    for (char *s = buf; *s;) {
+        while (*s && strchr(" \t\r\n\v", *s))
+            s++;
+        if (*s)
+            n++;
+        while (*s && !strchr(" \t\r\n\v", *s))
+            s++;
+    }
+    return n < MAXARGS;
+}
+
+// Run a simple command through vfork. The child borrows the memory of the
+// shell until execv instead of copying it, so it may only exec or _exit.
+void spawncmd(struct execcmd *ecmd) {
+    int pid;
+
+    if (ecmd->argv[0] == 0)
+        return;
+    pid = vfork();
+    if (pid == -1)
+        PANIC("vfork");
+    if (pid == 0) {
+        execv(ecmd->argv[0], ecmd->argv);
+        // stdio state is shared with the shell, keep away from it
+        write(2, "exec failed\n", 12);
+        _exit(1);
+    }
+    wait(NULL);
+}
+
 int getcmd(char *buf, int nbuf) {
     fprintf(stderr, "$ ");
     memset(buf, 0, nbuf);
@@ -186,6 +224,11 @@ int main(int argc, char *argv[]) {
                 fprintf(stderr, "cannot cd %s\n", buf + 3);
             continue;
         }
+        if (simplecmd(buf)) {
+            memused = 0;
+            spawncmd((struct execcmd *)parsecmd(buf));
+            continue;
+        }
         if (fork1() == 0)
             runcmd(parsecmd(buf));
         wait(NULL);
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <assert.h>
 #include <fcntl.h>
 #include <stdint.h>
@@ -5,6 +6,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
 #include <fs/defines.h>
 
 char buf[8192];
@@ -150,6 +156,377 @@ void createtest(void) {
     printf("many creates, followed by unlink; ok\n");
 }
 
+static long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+
+// 0: unlocked, 1: locked, 2: locked with waiters
+static void mutex_lock(int* m) {
+    int c = 0;
+    if (__atomic_compare_exchange_n(m, &c, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return;
+    if (c != 2)
+        c = __atomic_exchange_n(m, 2, __ATOMIC_ACQUIRE);
+    while (c != 0) {
+        syscall(SYS_futex, m, FUTEX_WAIT, 2, NULL, NULL, 0);
+        c = __atomic_exchange_n(m, 2, __ATOMIC_ACQUIRE);
+    }
+}
+
+static void mutex_unlock(int* m) {
+    if (__atomic_fetch_sub(m, 1, __ATOMIC_RELEASE) != 1) {
+        __atomic_store_n(m, 0, __ATOMIC_RELEASE);
+        syscall(SYS_futex, m, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+}
+
+#define MUTEX_NPROC 4
+#define MUTEX_ITERS 20000
+
+void futexbench(void) {
+    printf("futex mutex benchmark\n");
+    struct {
+        int mutex;
+        long counter;
+    }* shared = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        printf("mmap shared page failed\n");
+        exit(1);
+    }
+    long t0 = now_ms();
+    for (int i = 0; i < MUTEX_NPROC; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("fork failed\n");
+            exit(1);
+        }
+        if (pid == 0) {
+            for (int j = 0; j < MUTEX_ITERS; j++) {
+                mutex_lock(&shared->mutex);
+                shared->counter++;
+                mutex_unlock(&shared->mutex);
+            }
+            exit(0);
+        }
+    }
+    for (int i = 0; i < MUTEX_NPROC; i++)
+        wait(NULL);
+    long t = now_ms() - t0;
+    if (shared->counter != (long)MUTEX_NPROC * MUTEX_ITERS) {
+        printf("futex mutex lost updates: %ld\n", shared->counter);
+        exit(1);
+    }
+    printf("%d procs x %d lock/unlock: %ld ms\n", MUTEX_NPROC, MUTEX_ITERS, t);
+    printf("futex mutex benchmark ok\n");
+}
+
+#define SUM_N (1 << 20)
+#define SUM_PASSES 8
+#define SUM_MAX_THREADS 4
+#define THREAD_STACK_SIZE 16384
+
+static unsigned* sum_data;
+
+struct sum_arg {
+    int begin, end;
+    unsigned long sum;
+    volatile int tid; // cleared by the kernel when the thread exits
+};
+
+static int sum_worker(void* p) {
+    struct sum_arg* arg = p;
+    unsigned long sum = 0;
+    for (int pass = 0; pass < SUM_PASSES; pass++)
+        for (int i = arg->begin; i < arg->end; i++)
+            sum += sum_data[i];
+    arg->sum = sum;
+    return 0;
+}
+
+static void thread_join(struct sum_arg* arg) {
+    int tid;
+    while ((tid = arg->tid) != 0)
+        syscall(SYS_futex, &arg->tid, FUTEX_WAIT, tid, NULL, NULL, 0);
+}
+
+void threadbench(void) {
+    printf("thread parallel sum benchmark\n");
+    sum_data = mmap(NULL, SUM_N * sizeof(unsigned), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    char* stacks = mmap(NULL, SUM_MAX_THREADS * THREAD_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (sum_data == MAP_FAILED || stacks == MAP_FAILED) {
+        printf("mmap failed\n");
+        exit(1);
+    }
+    unsigned long expect = 0;
+    for (int i = 0; i < SUM_N; i++) {
+        sum_data[i] = i * 2654435761u;
+        expect += sum_data[i];
+    }
+    expect *= SUM_PASSES;
+    long base = 0;
+    for (int n = 1; n <= SUM_MAX_THREADS; n *= 2) {
+        struct sum_arg args[SUM_MAX_THREADS];
+        long t0 = now_ms();
+        for (int i = 0; i < n; i++) {
+            args[i].begin = SUM_N / n * i;
+            args[i].end = SUM_N / n * (i + 1);
+            args[i].tid = -1;
+            int flags = CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND | CLONE_THREAD | CLONE_SYSVSEM | CLONE_CHILD_CLEARTID;
+            if (clone(sum_worker, stacks + THREAD_STACK_SIZE * (i + 1), flags, &args[i], NULL, NULL, &args[i].tid) < 0) {
+                printf("clone failed\n");
+                exit(1);
+            }
+        }
+        unsigned long sum = 0;
+        for (int i = 0; i < n; i++) {
+            thread_join(&args[i]);
+            sum += args[i].sum;
+        }
+        long t = now_ms() - t0;
+        if (sum != expect) {
+            printf("parallel sum mismatch with %d threads\n", n);
+            exit(1);
+        }
+        if (n == 1)
+            base = t;
+        printf("%d threads: %ld ms, speedup %ld.%02ld\n", n, t, base / (t ? t : 1), base * 100 / (t ? t : 1) % 100);
+    }
+    printf("thread parallel sum benchmark ok\n");
+}
+
+static int exit_group_worker(void* code) {
+    syscall(SYS_exit_group, (int)(long)code);
+    return 0;
+}
+
+// a thread other than the leader ends the process, and the parent sees the
+// code it passed to exit_group.
+void exitgrouptest(void) {
+    static char stack[THREAD_STACK_SIZE];
+    printf("exit_group test\n");
+    int pid = fork();
+    if (pid < 0) {
+        printf("fork failed\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        int flags = CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND | CLONE_THREAD | CLONE_SYSVSEM;
+        if (clone(exit_group_worker, stack + THREAD_STACK_SIZE, flags, (void*)42) < 0)
+            exit(1);
+        // until the thread kills us
+        while (1) {}
+    }
+    int status;
+    if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 42) {
+        printf("exit_group from a thread: wrong exit status\n");
+        exit(1);
+    }
+    printf("exit_group test ok\n");
+}
+
+#define FORK_ROUNDS 1000
+#define EXEC_ROUNDS 200
+
+void forkbench(void) {
+    printf("fork/exec/wait benchmark\n");
+    long t0 = now_ms();
+    for (int i = 0; i < FORK_ROUNDS; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("fork failed\n");
+            exit(1);
+        }
+        if (pid == 0)
+            exit(0);
+        if (wait(NULL) < 0) {
+            printf("wait failed\n");
+            exit(1);
+        }
+    }
+    long t = now_ms() - t0;
+    printf("fork/wait: %d rounds, %ld ms, %ld per sec\n", FORK_ROUNDS, t, FORK_ROUNDS * 1000L / (t ? t : 1));
+    t0 = now_ms();
+    for (int i = 0; i < EXEC_ROUNDS; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("fork failed\n");
+            exit(1);
+        }
+        if (pid == 0) {
+            char* argv[] = {"echo", 0};
+            // keep the output of echo off the console
+            close(1);
+            execv("echo", argv);
+            exit(1);
+        }
+        if (wait(NULL) < 0) {
+            printf("wait failed\n");
+            exit(1);
+        }
+    }
+    t = now_ms() - t0;
+    printf("fork/exec/wait: %d rounds, %ld ms, %ld per sec\n", EXEC_ROUNDS, t, EXEC_ROUNDS * 1000L / (t ? t : 1));
+    printf("fork/exec/wait benchmark ok\n");
+}
+
+#define SH_COMMANDS 1000
+
+void shbench(void) {
+    printf("sh echo script benchmark\n");
+    int fd = open("shbench.sh", O_CREAT | O_RDWR);
+    if (fd < 0) {
+        printf("create shbench.sh failed\n");
+        exit(1);
+    }
+    for (int i = 0; i < SH_COMMANDS; i++) {
+        if (write(fd, "echo hello\n", 11) != 11) {
+            printf("write shbench.sh failed\n");
+            exit(1);
+        }
+    }
+    close(fd);
+    long t0 = now_ms();
+    int pid = fork();
+    if (pid < 0) {
+        printf("fork failed\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        char* argv[] = {"sh", 0};
+        // read the script, and keep the echoes and the prompts off the console
+        close(0);
+        if (open("shbench.sh", O_RDONLY) != 0)
+            exit(1);
+        close(1);
+        close(2);
+        if (open("shbench.out", O_CREAT | O_RDWR) != 1 || dup(1) != 2)
+            exit(1);
+        execv("sh", argv);
+        exit(1);
+    }
+    if (wait(NULL) < 0) {
+        printf("wait failed\n");
+        exit(1);
+    }
+    long t = now_ms() - t0;
+    unlink("shbench.sh");
+    unlink("shbench.out");
+    printf("%d commands: %ld ms, %ld per sec\n", SH_COMMANDS, t, SH_COMMANDS * 1000L / (t ? t : 1));
+    printf("sh echo script benchmark ok\n");
+}
+
+#define SYS_bcachestat 502
+
+// mirrors BlockCacheStat in fs/cache.h
+struct bcachestat {
+    unsigned long hits, misses, evictions;
+    unsigned long num_cached, capacity, max_capacity;
+    unsigned long logical_writes, device_writes;
+    unsigned long io_requests, io_depth, max_io_depth;
+};
+
+void bcachestat(void) {
+    struct bcachestat st;
+    if (syscall(SYS_bcachestat, &st, 0) < 0) {
+        printf("bcachestat failed\n");
+        exit(1);
+    }
+    unsigned long total = st.hits + st.misses;
+    printf("block cache: %lu hits, %lu misses (%lu%% hit), %lu evictions, %lu/%lu blocks, max %lu\n",
+           st.hits, st.misses, total ? st.hits * 100 / total : 0, st.evictions,
+           st.num_cached, st.capacity, st.max_capacity);
+    printf("block cache: %lu logical writes, %lu device writes (%lu.%02lu per logical write)\n",
+           st.logical_writes, st.device_writes,
+           st.logical_writes ? st.device_writes / st.logical_writes : 0,
+           st.logical_writes ? st.device_writes * 100 / st.logical_writes % 100 : 0);
+    printf("block cache: %lu async requests, %lu in flight, max %lu\n", st.io_requests,
+           st.io_depth, st.max_io_depth);
+}
+
+#define READ_FILE_BYTES (128 * 512)
+#define READ_CHUNK 512
+#define READ_ROUNDS 20
+
+// drop the cached blocks by shrinking the block cache, then give it its
+// room back so that the next reader starts cold.
+static void drop_bcache(void) {
+    struct bcachestat st;
+    if (syscall(SYS_bcachestat, &st, 0) < 0) {
+        printf("bcachestat failed\n");
+        exit(1);
+    }
+    syscall(SYS_bcachestat, 0, 1);
+    syscall(SYS_bcachestat, 0, st.max_capacity);
+}
+
+void readbench(void) {
+    static char buf[READ_CHUNK];
+    printf("sequential read benchmark\n");
+    int fd = open("readbench.dat", O_CREAT | O_RDWR);
+    if (fd < 0) {
+        printf("create readbench.dat failed\n");
+        exit(1);
+    }
+    memset(buf, 'r', sizeof(buf));
+    for (int i = 0; i < READ_FILE_BYTES / READ_CHUNK; i++) {
+        if (write(fd, buf, READ_CHUNK) != READ_CHUNK) {
+            printf("write readbench.dat failed\n");
+            exit(1);
+        }
+    }
+    close(fd);
+    long t = 0;
+    for (int i = 0; i < READ_ROUNDS; i++) {
+        drop_bcache();
+        long t0 = now_ms();
+        fd = open("readbench.dat", O_RDONLY);
+        if (fd < 0) {
+            printf("open readbench.dat failed\n");
+            exit(1);
+        }
+        int n, total = 0;
+        while ((n = read(fd, buf, READ_CHUNK)) > 0)
+            total += n;
+        close(fd);
+        t += now_ms() - t0;
+        if (total != READ_FILE_BYTES) {
+            printf("read readbench.dat: %d bytes, expected %d\n", total, READ_FILE_BYTES);
+            exit(1);
+        }
+    }
+    unlink("readbench.dat");
+    printf("cold read: %d KB x %d, %ld ms, %ld KB/s\n", READ_FILE_BYTES / 1024, READ_ROUNDS, t,
+           (long)READ_FILE_BYTES / 1024 * READ_ROUNDS * 1000 / (t ? t : 1));
+    t = 0;
+    for (int i = 0; i < EXEC_ROUNDS / 10; i++) {
+        drop_bcache();
+        long t0 = now_ms();
+        int pid = fork();
+        if (pid < 0) {
+            printf("fork failed\n");
+            exit(1);
+        }
+        if (pid == 0) {
+            char* argv[] = {"echo", 0};
+            close(1);
+            execv("echo", argv);
+            exit(1);
+        }
+        if (wait(NULL) < 0) {
+            printf("wait failed\n");
+            exit(1);
+        }
+        t += now_ms() - t0;
+    }
+    printf("cold fork/exec/wait: %d rounds, %ld ms\n", EXEC_ROUNDS / 10, t);
+    printf("sequential read benchmark ok\n");
+}
+
 int main(int argc, char* argv[]) {
     printf("usertests starting\n");
 
@@ -157,6 +534,13 @@ int main(int argc, char* argv[]) {
     writetest();
     writetestbig();
     createtest();
+    futexbench();
+    threadbench();
+    exitgrouptest();
+    forkbench();
+    shbench();
+    readbench();
+    bcachestat();
 
     exit(0);
 }